@@ -1,36 +1,177 @@
 #pragma once
+#include <cstddef>
+#include <cstdlib>
 #include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace lgn::memory
 {
+    // Bump allocator over a list of chunks. Objects are constructed in place
+    // and the ones that are not trivially destructible get their destructor
+    // run on reset() or when the arena goes away. reset() keeps the chunks
+    // around, so an arena reused across compilations stops touching the
+    // system allocator once it has grown to the size of the largest program.
     class ArenaAllocator {
     public:
-        inline explicit ArenaAllocator(size_t bytes) : m_size(bytes)
+        static constexpr size_t default_chunk_size = 64 * 1024;
+        static constexpr size_t max_chunk_size = 16 * 1024 * 1024;
+
+        inline explicit ArenaAllocator(size_t chunk_size = default_chunk_size) : m_chunk_size(chunk_size) {}
+
+        template <typename T, typename... Args>
+        inline T* alloc(Args&&... args)
         {
-            m_buffer = static_cast<std::byte*>(malloc(m_size));
-            m_offset = m_buffer;
+            static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned types are not supported");
+
+            void* memory = alloc_bytes(sizeof(T), alignof(T));
+            T* object = ::new (memory) T(std::forward<Args>(args)...);
+
+            if constexpr (!std::is_trivially_destructible_v<T>) {
+                auto finalizer = static_cast<Finalizer*>(alloc_bytes(sizeof(Finalizer), alignof(Finalizer)));
+
+                finalizer->destroy = [](void* ptr) { static_cast<T*>(ptr)->~T(); };
+                finalizer->object = object;
+                finalizer->next = m_finalizers;
+                m_finalizers = finalizer;
+            }
+
+            return object;
         }
 
-        template <typename T>
-        inline T* alloc()
+        inline void* alloc_bytes(size_t bytes, size_t align = alignof(std::max_align_t))
         {
-            void* offset = m_offset;
-            m_offset += sizeof(T);
-            return static_cast<T*>(offset);
+            if (m_current) {
+                size_t offset = align_up(m_offset, align);
+
+                if (offset + bytes <= m_current->size) {
+                    m_used += offset + bytes - m_offset;
+                    m_offset = offset + bytes;
+                    update_peak();
+
+                    return m_current->data() + offset;
+                }
+            }
+
+            return alloc_slow(bytes, align);
         }
 
+        // Destroys every object and rewinds to the first chunk without
+        // releasing any memory.
+        inline void reset()
+        {
+            run_finalizers();
+
+            m_current = m_head;
+            m_offset = 0;
+            m_used = 0;
+        }
+
+        inline size_t bytes_used() const { return m_used; }
+        inline size_t bytes_reserved() const { return m_reserved; }
+        inline size_t peak_bytes() const { return m_peak; }
+        inline size_t chunk_count() const { return m_chunks; }
+
         inline ArenaAllocator(const ArenaAllocator& other) = delete;
 
-        inline ArenaAllocator operator=(const ArenaAllocator& other) = delete;
+        inline ArenaAllocator& operator=(const ArenaAllocator& other) = delete;
 
         inline ~ArenaAllocator()
         {
-            free(m_buffer);
+            run_finalizers();
+
+            while (m_head) {
+                Chunk* next = m_head->next;
+                free(m_head);
+                m_head = next;
+            }
         }
 
     private:
-        size_t m_size;
-        std::byte *m_buffer;
-        std::byte *m_offset;
+        struct alignas(std::max_align_t) Chunk {
+            Chunk* next;
+            size_t size;
+
+            inline std::byte* data() { return reinterpret_cast<std::byte*>(this + 1); }
+        };
+
+        struct Finalizer {
+            void (*destroy)(void*);
+            void* object;
+            Finalizer* next;
+        };
+
+        size_t m_chunk_size;
+
+        Chunk* m_head = nullptr;
+        Chunk* m_current = nullptr;
+        size_t m_offset = 0;
+
+        Finalizer* m_finalizers = nullptr;
+
+        size_t m_used = 0;
+        size_t m_reserved = 0;
+        size_t m_peak = 0;
+        size_t m_chunks = 0;
+
+        static inline size_t align_up(size_t value, size_t align)
+        {
+            return (value + align - 1) & ~(align - 1);
+        }
+
+        inline void update_peak()
+        {
+            if (m_used > m_peak)
+                m_peak = m_used;
+        }
+
+        // Moves on to the next chunk, reusing one kept by reset() when it is
+        // large enough and splicing in a fresh, larger one otherwise.
+        inline void* alloc_slow(size_t bytes, size_t align)
+        {
+            size_t needed = bytes + align;
+
+            if (m_current && m_current->next && m_current->next->size >= needed) {
+                m_current = m_current->next;
+            } else {
+                size_t size = m_chunk_size > needed ? m_chunk_size : needed;
+                auto chunk = static_cast<Chunk*>(malloc(sizeof(Chunk) + size));
+
+                if (!chunk)
+                    throw std::bad_alloc();
+
+                chunk->size = size;
+                m_reserved += size;
+                m_chunks++;
+
+                // Grow geometrically so large programs need few chunks
+                if (m_chunk_size < max_chunk_size)
+                    m_chunk_size *= 2;
+
+                if (m_current) {
+                    chunk->next = m_current->next;
+                    m_current->next = chunk;
+                } else {
+                    chunk->next = m_head;
+                    m_head = chunk;
+                }
+
+                m_current = chunk;
+            }
+
+            m_offset = 0;
+
+            return alloc_bytes(bytes, align);
+        }
+
+        inline void run_finalizers()
+        {
+            while (m_finalizers) {
+                Finalizer* finalizer = m_finalizers;
+                m_finalizers = finalizer->next;
+                finalizer->destroy(finalizer->object);
+            }
+        }
     };
 }
\ No newline at end of file
@@ -1,206 +1,343 @@
 #include "Assembler.h"
-#include <format>
+#include <algorithm>
 using namespace lgn;
+using x86::Op;
+using x86::Operand;
+using x86::Reg;
 
-std::string Assembler::assemble()
+namespace
 {
-	m_output << "global _start\n_start:\n";
+	// Registers available to expressions. rax and rdx are left out because
+	// div uses them implicitly and r11 is kept as the reload register for
+	// spilled operands.
+	constexpr std::array<Reg, 7> expr_regs = { Reg::rbx, Reg::rcx, Reg::rsi, Reg::rdi, Reg::r8, Reg::r9, Reg::r10 };
+	constexpr Reg spill_reg = Reg::r11;
 
-	for (const node::Statement *stmt : m_prog.statements)
-		assemble_statement(stmt);
-
-	if (need_exit) {
-		m_output << "    mov rax, 60\n";
-		m_output << "    mov rdi, 0\n";
-		m_output << "    syscall";
+	inline bool is_binary(flat::Kind kind)
+	{
+		return kind >= flat::Kind::add && kind <= flat::Kind::div;
 	}
+}
+
+Assembler::RegList Assembler::RegList::tail() const
+{
+	RegList list{ .regs = {}, .size = size - 1 };
+	std::copy(regs.begin() + 1, regs.begin() + size, list.regs.begin());
 
-	return m_output.str();
+	return list;
 }
 
-void Assembler::assemble_statement(const node::Statement* stmt)
+Assembler::RegList Assembler::RegList::swap_front() const
 {
-	struct StmtVisitor {
-		Assembler& assembler;
+	RegList list = *this;
+	std::swap(list.regs[0], list.regs[1]);
 
-		void operator()(const node::StatementExit* stmt_exit) const
-		{
-			assembler.assemble_expr(stmt_exit->expr);
-					 
-			assembler.m_output << "    mov rax, 60\n";
-			assembler.pop("rdi");
-			assembler.m_output << "    syscall\n";
-					 
-			assembler.need_exit = false;
-		}
+	return list;
+}
 
-		void operator()(const node::StatementLet *stmt_let) const
-		{
-			std::string var_name = stmt_let->tok_id.value.value();
-			auto iterator = std::find_if(assembler.m_vars.cbegin(), assembler.m_vars.cend(), [&](const Var& var) {
-				return var.name == var_name;
-			});
-
-			if (iterator != assembler.m_vars.cend()) {
-				std::cerr << "Identifier '" << var_name << "' is already declared" << std::endl;
-				exit(EXIT_SUCCESS);
-			}
-			
-			assembler.m_vars.push_back({ .name = var_name, .sp = assembler.m_ssize });
-			assembler.assemble_expr(stmt_let->expr);
-		}
+void Assembler::assemble(x86::InstrSink& sink)
+{
+	number_nodes();
+	m_slot_sp.assign(m_ast.slot_count(), 0);
 
-		void operator()(const node::StatementIf* stmt_if) const
-		{
-			std::string label = assembler.create_label();
+	assemble_entry();
+	assemble_statements(sink);
+	assemble_end(sink, false);
+}
 
-			assembler.assemble_expr(stmt_if->expr);
-			assembler.pop("rax");
-			assembler.m_output << "    test rax, rax\n";
-			assembler.m_output << "    jz " << label << "\n";
-			assembler.create_scope(stmt_if->scope);
-			assembler.m_output << "\n" << label << ":\n";
+// Only top-level lets change the stack across statements, spills and
+// scopes give back what they take, and only ifs create labels
+bool Assembler::plan(std::vector<Start>& starts, std::vector<size_t>& slots) const
+{
+	Start start;
+	bool exited = false;
+
+	starts.clear();
+	slots.assign(m_ast.slot_count(), 0);
+
+	for (flat::Index stmt : m_ast.statements(m_ast.root())) {
+		starts.push_back(start);
+
+		switch (m_ast.kind(stmt)) {
+		case flat::Kind::exit:
+			exited = true;
+			break;
+		case flat::Kind::let:
+			slots[m_ast.rhs(stmt)] = start.stack_size++;
+			break;
+		default:
+			start.label_base += count_labels(stmt);
+			break;
 		}
+	}
 
-		void operator()(const node::Scope* scope) const
-		{
-			assembler.create_scope(scope);
-		}
-	};
+	return exited;
+}
 
-	StmtVisitor visitor{ .assembler = *this };
-	std::visit(visitor, stmt->statement);
+void Assembler::prepare(std::span<const size_t> slots)
+{
+	number_nodes();
+	m_slot_sp.assign(slots.begin(), slots.end());
 }
 
-void Assembler::assemble_term(const node::Term* term)
+void Assembler::assemble_at(x86::InstrSink& sink, size_t index, const Start& start)
 {
-	struct TermVisitor {
-		Assembler& assembler;
+	m_ssize = start.stack_size;
+	m_var_count = start.stack_size;
+	m_label_count = start.label_base;
 
-		void operator()(const node::TermInt* term_int) const
-		{
-			//assembler.m_output << "    mov rax, " << term_int->tok_int.value.value() << "\n";
-			assembler.push(term_int->tok_int.value.value());
-		}
+	if (index == 0)
+		assemble_entry();
+
+	assemble_statement(m_ast.statements(m_ast.root())[index]);
+
+	sink.write(m_code);
+	m_code.clear();
+}
 
-		void operator()(const node::TermId* term_id) const
-		{
-			std::string var_name = term_id->tok_id.value.value();
-			auto iterator = std::find_if(assembler.m_vars.cbegin(), assembler.m_vars.cend(), [&](const Var& var) {
-				return var.name == var_name;
-			});
+void Assembler::assemble_part(x86::InstrSink& sink, const Frame& frame)
+{
+	number_nodes();
+	m_slot_sp.assign(m_ast.slot_count(), 0);
+	std::copy(frame.slots.begin(), frame.slots.end(), m_slot_sp.begin());
 
-			if (iterator == assembler.m_vars.cend()) {
-				std::cerr << "Undeclared identifier '" << var_name << "'" << std::endl;
-				exit(EXIT_SUCCESS);
-			}
+	m_ssize = frame.stack_size;
+	m_var_count = frame.stack_size;
 
-			if ((assembler.m_ssize - (*iterator).sp - 1) * 8 > 0) {
-				std::stringstream offset;
+	assemble_statements(sink);
+}
 
-				offset << "qword [rsp + " << (assembler.m_ssize - (*iterator).sp - 1) * 8 << "]";
-				assembler.push(offset.str());
-			}
-		}
+void Assembler::assemble_end(x86::InstrSink& sink, bool exited)
+{
+	if (need_exit && !exited)
+		emit_exit(Operand::imm(0));
 
-		void operator()(const node::TermParen* term_paren) const
-		{
-			assembler.assemble_expr(term_paren->expr);
-		}
-	};
+	sink.write(m_code);
+	m_code.clear();
+
+	sink.finish();
+}
 
-	TermVisitor visitor{ .assembler = *this };
-	std::visit(visitor, term->term);
+// rbx is callee-saved and rbp anchors the frame so any exit can unwind
+// the variables still on the stack
+void Assembler::assemble_entry()
+{
+	if (m_target == Target::function) {
+		emit(Op::push, Operand::make_reg(Reg::rbx));
+		emit(Op::push, Operand::make_reg(Reg::rbp));
+		emit(Op::mov, Operand::make_reg(Reg::rbp), Operand::make_reg(Reg::rsp));
+	}
 }
 
-void Assembler::assemble_bin_expr(const node::BinExpr* bin_expr)
+void Assembler::assemble_statements(x86::InstrSink& sink)
 {
-	struct BinExprVisitor
+	for (flat::Index stmt : m_ast.statements(m_ast.root())) {
+		assemble_statement(stmt);
+
+		sink.write(m_code);
+		m_code.clear();
+	}
+}
+
+void Assembler::assemble_statement(flat::Index stmt)
+{
+	switch (m_ast.kind(stmt)) {
+	case flat::Kind::exit:
 	{
-		Assembler& assembler;
-
-		void operator()(const node::BinExprAdd* add) const
-		{
-			assembler.assemble_expr(add->right);
-			assembler.assemble_expr(add->left);
-			assembler.pop("rax");
-			assembler.pop("rbx");
-			assembler.m_output << "    add rax, rbx\n";
-			assembler.push("rax");
-		}
+		emit_exit(Operand::make_reg(assemble_expr(m_ast.lhs(stmt))));
 
-		void operator()(const node::BinExprSub* sub) const
-		{
-			assembler.assemble_expr(sub->right);
-			assembler.assemble_expr(sub->left);
-			assembler.pop("rax");
-			assembler.pop("rbx");
-			assembler.m_output << "    sub rax, rbx\n";
-			assembler.push("rax");
-		}
+		// An exit inside a scope may be skipped, the fallback is still needed
+		if (m_scopes.empty())
+			need_exit = false;
+		break;
+	}
+	case flat::Kind::let:
+	{
+		// The variable lives in the stack position its push lands in
+		Reg reg = assemble_expr(m_ast.lhs(stmt));
+		m_slot_sp[m_ast.rhs(stmt)] = m_ssize;
+		m_var_count++;
+		push(Operand::make_reg(reg));
+		break;
+	}
+	case flat::Kind::if_:
+	{
+		Operand label = create_label();
+		Reg reg = assemble_expr(m_ast.lhs(stmt));
+
+		emit(Op::test, Operand::make_reg(reg), Operand::make_reg(reg));
+		emit(Op::jz, label);
+		create_scope(m_ast.rhs(stmt));
+		emit(Op::label, label);
+		break;
+	}
+	case flat::Kind::scope:
+		create_scope(stmt);
+		break;
+	default:
+		break;
+	}
+}
 
-		void operator()(const node::BinExprMul* mul) const
-		{
-			assembler.assemble_expr(mul->right);
-			assembler.assemble_expr(mul->left);
-			assembler.pop("rax");
-			assembler.pop("rbx");
-			assembler.m_output << "    mul rbx\n";
-			assembler.push("rax");
-		}
+uint64_t Assembler::count_labels(flat::Index stmt) const
+{
+	uint64_t count = 0;
+
+	switch (m_ast.kind(stmt)) {
+	case flat::Kind::if_:
+		count++;
+		stmt = m_ast.rhs(stmt);
+		[[fallthrough]];
+	case flat::Kind::scope:
+		for (flat::Index inner : m_ast.statements(stmt))
+			count += count_labels(inner);
+		break;
+	default:
+		break;
+	}
 
-		void operator()(const node::BinExprDiv* div) const
-		{
-			assembler.assemble_expr(div->right);
-			assembler.assemble_expr(div->left);
-			assembler.pop("rax");
-			assembler.pop("rbx");
-			assembler.m_output << "    div rbx\n";
-			assembler.push("rax");
-		}
-	};
+	return count;
+}
+
+Reg Assembler::assemble_expr(flat::Index expr)
+{
+	RegList regs{ .regs = {}, .size = expr_regs.size() };
+	std::copy(expr_regs.begin(), expr_regs.end(), regs.regs.begin());
 
-	BinExprVisitor visitor{ .assembler = *this };
-	std::visit(visitor, bin_expr->expr);
+	assemble_expr(expr, regs);
+
+	return regs.regs[0];
 }
 
-void Assembler::assemble_expr(const node::Expr *expr)
+// Children are stored before their parents, so one forward pass sees both
+// operands of a binary node before the node itself.
+void Assembler::number_nodes()
 {
-	struct ExprVisitor {
-		Assembler *assembler;
+	m_need.assign(m_ast.size(), 0);
 
-		void operator()(const node::Term *term)
-		{
-			assembler->assemble_term(term);
-		}
+	for (flat::Index node = 0; node < m_ast.size(); node++) {
+		flat::Kind kind = m_ast.kind(node);
 
-		void operator()(const node::BinExpr* bin_expr) const
-		{
-			assembler->assemble_bin_expr(bin_expr);
+		if (kind == flat::Kind::int_lit || kind == flat::Kind::var) {
+			m_need[node] = 1;
+		} else if (is_binary(kind)) {
+			uint8_t left = m_need[m_ast.lhs(node)];
+			uint8_t right = m_need[m_ast.rhs(node)];
+
+			m_need[node] = left == right ? left + 1 : std::max(left, right);
 		}
-	};
+	}
+}
 
-	ExprVisitor visitor{ .assembler = this };
-	std::visit(visitor, expr->expr);
+// Sethi-Ullman evaluation: the operand that needs more registers goes
+// first, the other one is evaluated into the remaining registers. When
+// neither fits the right operand is spilled to the stack and reloaded
+// into the scratch register.
+void Assembler::assemble_expr(flat::Index expr, const RegList& regs)
+{
+	Reg dst = regs.regs[0];
+
+	switch (m_ast.kind(expr)) {
+	case flat::Kind::int_lit:
+		emit(Op::mov, Operand::make_reg(dst), Operand::imm(m_ast.literal(expr)));
+		return;
+	case flat::Kind::var:
+		emit(Op::mov, Operand::make_reg(dst), Operand::mem(Reg::rsp, (m_ssize - m_slot_sp[m_ast.lhs(expr)] - 1) * 8));
+		return;
+	default:
+		break;
+	}
+
+	flat::Index left = m_ast.lhs(expr);
+	flat::Index right = m_ast.rhs(expr);
+	size_t need_left = m_need[left];
+	size_t need_right = m_need[right];
+
+	if (regs.size == 1 || (need_left >= regs.size && need_right >= regs.size)) {
+		assemble_expr(right, regs);
+		push(Operand::make_reg(dst));
+		assemble_expr(left, regs);
+		pop(spill_reg);
+		assemble_op(m_ast.kind(expr), dst, spill_reg);
+	} else if (need_left >= need_right) {
+		assemble_expr(left, regs);
+		assemble_expr(right, regs.tail());
+		assemble_op(m_ast.kind(expr), dst, regs.regs[1]);
+	} else {
+		RegList swapped = regs.swap_front();
+
+		assemble_expr(right, swapped);
+		assemble_expr(left, swapped.tail());
+		assemble_op(m_ast.kind(expr), dst, regs.regs[1]);
+	}
+}
+
+void Assembler::assemble_op(flat::Kind kind, Reg dst, Reg src)
+{
+	switch (kind) {
+	case flat::Kind::add:
+		emit(Op::add, Operand::make_reg(dst), Operand::make_reg(src));
+		break;
+	case flat::Kind::sub:
+		emit(Op::sub, Operand::make_reg(dst), Operand::make_reg(src));
+		break;
+	case flat::Kind::mul:
+		// Only the low 64 bits are kept, which imul computes just like mul
+		emit(Op::imul, Operand::make_reg(dst), Operand::make_reg(src));
+		break;
+	case flat::Kind::div:
+		emit(Op::mov, Operand::make_reg(Reg::rax), Operand::make_reg(dst));
+		emit(Op::xor_, Operand::make_reg(Reg::rdx), Operand::make_reg(Reg::rdx));
+		emit(Op::div, Operand::make_reg(src));
+		emit(Op::mov, Operand::make_reg(dst), Operand::make_reg(Reg::rax));
+		break;
+	default:
+		break;
+	}
+}
+
+void Assembler::emit(Op op, Operand dst, Operand src)
+{
+	m_code.push_back({ .op = op, .dst = dst, .src = src });
+	m_emitted++;
 }
 
-void Assembler::push(const std::string& reg)
+void Assembler::emit_exit(Operand value)
 {
-	m_output << "    push " << reg << "\n";
+	if (m_target == Target::function) {
+		emit(Op::mov, Operand::make_reg(Reg::rax), value);
+		emit(Op::mov, Operand::make_reg(Reg::rsp), Operand::make_reg(Reg::rbp));
+		emit(Op::pop, Operand::make_reg(Reg::rbp));
+		emit(Op::pop, Operand::make_reg(Reg::rbx));
+		emit(Op::ret);
+		return;
+	}
+
+	emit(Op::mov, Operand::make_reg(Reg::rax), Operand::imm(60));
+
+	if (!value.is_reg(Reg::rdi))
+		emit(Op::mov, Operand::make_reg(Reg::rdi), value);
+
+	emit(Op::syscall);
+}
+
+void Assembler::push(Operand src)
+{
+	emit(Op::push, src);
 	m_ssize++;
 }
 
-void Assembler::pop(const std::string& reg)
+void Assembler::pop(Reg reg)
 {
-	m_output << "    pop " << reg << "\n";
+	emit(Op::pop, Operand::make_reg(reg));
 	m_ssize--;
 }
 
-void Assembler::create_scope(const node::Scope* scope)
+void Assembler::create_scope(flat::Index scope)
 {
 	begin_scope();
 
-	for (const node::Statement* stmt : scope->statements)
+	for (flat::Index stmt : m_ast.statements(scope))
 		assemble_statement(stmt);
 
 	end_scope();
@@ -208,22 +345,21 @@ void Assembler::create_scope(const node::Scope* scope)
 
 void Assembler::begin_scope()
 {
-	m_scopes.push_back(m_vars.size());
+	m_scopes.push_back(m_var_count);
 }
 
 void Assembler::end_scope()
 {
-	size_t vars_count = m_vars.size() - m_scopes.back();
-
-	m_output << "    add rsp, " << vars_count * 8 << "\n";
+	size_t vars_count = m_var_count - m_scopes.back();
 
-	for (size_t i = 0; i < vars_count; i++)
-		m_vars.pop_back();
+	emit(Op::add, Operand::make_reg(Reg::rsp), Operand::imm(vars_count * 8));
+	m_ssize -= vars_count;
+	m_var_count -= vars_count;
 
 	m_scopes.pop_back();
 }
 
-std::string Assembler::create_label()
+Operand Assembler::create_label()
 {
-	return std::format("label_{}", m_label_count++);
+	return Operand::label(m_label_count++);
 }
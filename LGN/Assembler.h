@@ -1,7 +1,8 @@
 #pragma once
-#include "Node.h"
-#include <sstream>
-#include <variant>
+#include "FlatAst.h"
+#include "Instr.h"
+#include "Error.h"
+#include <array>
 #include <iostream>
 
 namespace lgn
@@ -9,38 +10,112 @@ namespace lgn
 	class Assembler
 	{
 	public:
-		Assembler(const node::Program& prog) : m_prog(prog) {}
+		enum class Target {
+			// Standalone program, exit ends the process through a syscall
+			executable,
+			// Function following the System V ABI, exit returns the value
+			function
+		};
+
+		// What the statements before a part of a program left on the stack
+		struct Frame {
+			size_t stack_size = 0;
+			// Stack position of the variables declared before the part,
+			// which the Resolver bound to the first slots
+			std::span<const size_t> slots {};
+		};
+
+		// Where a top-level statement starts, as the statements before it
+		// leave things
+		struct Start {
+			size_t stack_size = 0;
+			uint64_t label_base = 0;
+		};
+
+		Assembler(const flat::Ast& ast, Target target = Target::executable) : m_ast(ast), m_target(target) {}
+
+		// Streams the program into the sink, one top-level statement at a time
+		void assemble(x86::InstrSink& sink);
+
+		// For assembling a program in parts: the top-level statements of
+		// the Ast, continuing from frame, without the entry code, the
+		// fallback exit or finishing the sink. Labels start from 0 in each
+		// part.
+		void assemble_part(x86::InstrSink& sink, const Frame& frame);
 
-		std::string assemble();
-		void assemble_statement(const node::Statement *stmt);
-		void assemble_term(const node::Term *term);
-		void assemble_expr(const node::Expr *expr);
-		void assemble_bin_expr(const node::BinExpr* expr);
+		// Ends a program assembled in parts, exited tells whether one of
+		// them exits at the top level
+		void assemble_end(x86::InstrSink& sink, bool exited);
+
+		// For assembling the top-level statements apart from each other, on
+		// several threads. A sequential pre-pass over the statements, which
+		// does not look into expressions: fills starts with where each one
+		// starts and slots with the stack position of every top-level
+		// variable. Returns whether one of them exits at the top level.
+		bool plan(std::vector<Start>& starts, std::vector<size_t>& slots) const;
+
+		// Sets up for assemble_at(), with slots from plan()
+		void prepare(std::span<const size_t> slots);
+
+		// Assembles top-level statement index from start. Statement 0 comes
+		// with the entry code. Finish with assemble_end().
+		void assemble_at(x86::InstrSink& sink, size_t index, const Start& start);
+
+		// Whether the statements so far exit at the top level
+		inline bool exits() const { return !need_exit; }
+		void assemble_statement(flat::Index stmt);
+		x86::Reg assemble_expr(flat::Index expr);
+
+		// Instructions generated so far, before any peephole rewriting
+		inline size_t emitted() const { return m_emitted; }
 
 	private:
-		struct Var {
-			std::string name;
-			size_t sp;
+		// Registers an expression may be evaluated into, the result always
+		// ends up in the first one.
+		struct RegList {
+			std::array<x86::Reg, 8> regs;
+			size_t size;
+
+			RegList tail() const;
+			RegList swap_front() const;
 		};
 
-		const node::Program m_prog;
-		std::stringstream m_output;
+		const flat::Ast& m_ast;
+		Target m_target;
+		// Code of the top-level statement being assembled
+		std::vector<x86::Instr> m_code;
 
 		size_t m_ssize = 0;
-		int m_label_count = 0;
+		uint64_t m_label_count = 0;
+		size_t m_emitted = 0;
 
-		std::vector<Var> m_vars {};
+		// Stack position of every variable slot assigned by the Resolver
+		std::vector<size_t> m_slot_sp {};
+		size_t m_var_count = 0;
 		std::vector<size_t> m_scopes {};
 
+		// Sethi-Ullman number of every expression node: how many registers
+		// it needs to be evaluated without spilling.
+		std::vector<uint8_t> m_need {};
+
 		bool need_exit = true;
 
-		void push(const std::string& reg);
-		void pop(const std::string& reg);
+		void number_nodes();
+		void assemble_entry();
+		uint64_t count_labels(flat::Index stmt) const;
+		void assemble_statements(x86::InstrSink& sink);
+		void assemble_expr(flat::Index expr, const RegList& regs);
+		void assemble_op(flat::Kind kind, x86::Reg dst, x86::Reg src);
+
+		void emit(x86::Op op, x86::Operand dst = {}, x86::Operand src = {});
+		void emit_exit(x86::Operand value);
+		void push(x86::Operand src);
+		void pop(x86::Reg reg);
 
-		void create_scope(const node::Scope* scope);
+		void create_scope(flat::Index scope);
 		void begin_scope();
 		void end_scope();
 
-		std::string create_label();
+		x86::Operand create_label();
 	};
 }
@@ -0,0 +1,137 @@
+#include "Bytecode.h"
+#include "Error.h"
+using namespace lgn;
+using namespace lgn::vm;
+
+namespace
+{
+	class Emitter
+	{
+	public:
+		Emitter(const flat::Ast& ast, Program& program) : m_ast(ast), m_program(program) {}
+
+		void statements(flat::Index scope)
+		{
+			for (flat::Index stmt : m_ast.statements(scope))
+				statement(stmt);
+		}
+
+		void finish()
+		{
+			// Falling off the end exits with 0
+			emit(Op::push_const, constant(0), 1);
+			emit(Op::exit, 0, -1);
+		}
+
+	private:
+		const flat::Ast& m_ast;
+		Program& m_program;
+		size_t m_depth = 0;
+
+		void statement(flat::Index stmt)
+		{
+			switch (m_ast.kind(stmt)) {
+			case flat::Kind::exit:
+				expr(m_ast.lhs(stmt));
+				emit(Op::exit, 0, -1);
+				break;
+			case flat::Kind::let:
+				expr(m_ast.lhs(stmt));
+				emit(Op::store, m_ast.rhs(stmt), -1);
+				break;
+			case flat::Kind::if_:
+			{
+				expr(m_ast.lhs(stmt));
+
+				size_t jump = m_program.code.size();
+				emit(Op::jz, 0, -1);
+				statements(m_ast.rhs(stmt));
+
+				m_program.code[jump].a = static_cast<uint32_t>(m_program.code.size());
+				break;
+			}
+			case flat::Kind::scope:
+				statements(stmt);
+				break;
+			default:
+				break;
+			}
+		}
+
+		void expr(flat::Index root)
+		{
+			for (flat::Index node = m_ast.first(root); node <= root; node++) {
+				switch (m_ast.kind(node)) {
+				case flat::Kind::int_lit:
+					emit(Op::push_const, constant(m_ast.literal(node)), 1);
+					break;
+				case flat::Kind::var:
+					emit(Op::push_slot, m_ast.lhs(node), 1);
+					break;
+				case flat::Kind::add:
+					binary(Op::add, Op::add_const, Op::add_slot);
+					break;
+				case flat::Kind::sub:
+					binary(Op::sub, Op::sub_const, Op::sub_slot);
+					break;
+				case flat::Kind::mul:
+					binary(Op::mul, Op::mul_const, Op::mul_slot);
+					break;
+				case flat::Kind::div:
+					binary(Op::div, Op::div_const, Op::div_slot);
+					break;
+				default:
+					break;
+				}
+			}
+		}
+
+		// In post-order the right operand is the node just before its
+		// operator, so a leaf on the right is the last instruction emitted
+		void binary(Op op, Op with_const, Op with_slot)
+		{
+			Instr& last = m_program.code.back();
+
+			if (last.op == Op::push_const) {
+				last.op = with_const;
+				m_depth--;
+			} else if (last.op == Op::push_slot) {
+				last.op = with_slot;
+				m_depth--;
+			} else {
+				emit(op, 0, -1);
+			}
+		}
+
+		void emit(Op op, uint32_t a, int depth_change)
+		{
+			m_program.code.push_back({ .op = op, .a = a });
+			m_depth += depth_change;
+			m_program.stack_size = std::max(m_program.stack_size, m_depth);
+		}
+
+		uint32_t constant(uint64_t value)
+		{
+			m_program.constants.push_back(value);
+			return static_cast<uint32_t>(m_program.constants.size() - 1);
+		}
+	};
+}
+
+void Program::clear()
+{
+	code.clear();
+	constants.clear();
+	slot_count = 0;
+	stack_size = 0;
+}
+
+void vm::compile(const flat::Ast& ast, Program& program)
+{
+	program.clear();
+	program.slot_count = ast.slot_count();
+
+	Emitter emitter(ast, program);
+	emitter.statements(ast.root());
+	emitter.finish();
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "FlatAst.h"
+#include <cstdint>
+#include <vector>
+
+namespace lgn::vm
+{
+	enum class Op : uint32_t {
+		push_const,	// a: constant
+		push_slot,	// a: slot
+		add,		// pops the right operand, applies it to the left one in place
+		sub,
+		mul,
+		div,
+		// Superinstructions for a binary operator whose right operand is a
+		// literal or a variable, the operand is read directly
+		add_const,	// a: constant
+		sub_const,
+		mul_const,
+		div_const,
+		add_slot,	// a: slot
+		sub_slot,
+		mul_slot,
+		div_slot,
+		store,		// a: slot, pops the value
+		jz,			// a: target instruction, pops the condition
+		exit,		// pops the exit value
+	};
+
+	constexpr size_t op_count = static_cast<size_t>(Op::exit) + 1;
+
+	struct Instr {
+		Op op;
+		uint32_t a = 0;
+	};
+
+	// Stack bytecode for the VM. Every let has its own slot, so scopes need
+	// no instructions at all: a slot is simply not read outside its scope.
+	struct Program {
+		std::vector<Instr> code;
+		std::vector<uint64_t> constants;
+		size_t slot_count = 0;
+		// Deepest the operand stack gets
+		size_t stack_size = 0;
+
+		void clear();
+	};
+
+	// Translates a resolved flat AST into program, reusing its buffers.
+	// Expressions are already in post-order, which is the order a stack
+	// machine evaluates them in, so each node becomes one instruction or
+	// folds into the one before it.
+	void compile(const flat::Ast& ast, Program& program);
+}
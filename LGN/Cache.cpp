@@ -0,0 +1,268 @@
+#include "Cache.h"
+#include "Hash.h"
+#include "SourceFile.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+using namespace lgn;
+
+namespace
+{
+	// Entries start with the magic and the code size, anything else found
+	// under an entry name is treated as missing
+	constexpr char entry_magic[8] = { 'L', 'G', 'N', 'C', 'O', 'D', 'E', '1' };
+	constexpr size_t header_size = sizeof(entry_magic) + sizeof(uint64_t);
+
+	constexpr std::string_view stats_name = "stats";
+	constexpr std::string_view temp_prefix = "tmp.";
+
+	bool make_directories(const std::string& path)
+	{
+		for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+			std::string prefix = path.substr(0, slash);
+
+			if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST)
+				return false;
+
+			if (slash == std::string::npos)
+				return true;
+		}
+	}
+
+	bool is_entry_name(std::string_view name)
+	{
+		return name.size() == 32 && name.find_first_not_of("0123456789abcdef") == std::string_view::npos;
+	}
+
+	// Holds an exclusive flock for as long as it lives
+	class FileLock
+	{
+	public:
+		explicit FileLock(const std::string& path) : m_fd(open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644))
+		{
+			if (m_fd >= 0)
+				flock(m_fd, LOCK_EX);
+		}
+
+		~FileLock()
+		{
+			if (m_fd >= 0)
+				close(m_fd);
+		}
+
+		inline int fd() const { return m_fd; }
+
+	private:
+		int m_fd;
+	};
+}
+
+Cache::Cache(std::string directory, uint64_t limit) : m_dir(std::move(directory)), m_limit(limit)
+{
+	while (m_dir.size() > 1 && m_dir.back() == '/')
+		m_dir.pop_back();
+
+	if (m_dir.empty() || !make_directories(m_dir))
+		return;
+
+	SourceFile compiler("/proc/self/exe");
+
+	if (!compiler.is_open())
+		return;
+
+	m_compiler = hash64(compiler.view());
+	m_open = true;
+}
+
+std::string Cache::default_directory()
+{
+	if (const char* dir = getenv("LGN_CACHE_DIR"); dir && *dir)
+		return dir;
+
+	if (const char* dir = getenv("XDG_CACHE_HOME"); dir && *dir)
+		return std::string(dir) + "/lgn";
+
+	if (const char* home = getenv("HOME"); home && *home)
+		return std::string(home) + "/.cache/lgn";
+
+	return {};
+}
+
+Cache::Key Cache::key(std::string_view source, std::string_view options) const
+{
+	uint64_t seed = hash64(options, m_compiler);
+
+	return { .high = hash64(source, seed), .low = hash64(source, ~seed) };
+}
+
+bool Cache::load(const Key& key, std::vector<uint8_t>& code)
+{
+	int fd = open(path(key).c_str(), O_RDONLY | O_CLOEXEC);
+	bool hit = false;
+
+	if (fd >= 0) {
+		char header[header_size];
+		uint64_t size = 0;
+		struct stat info {};
+
+		if (fstat(fd, &info) == 0 && pread(fd, header, header_size, 0) == static_cast<ssize_t>(header_size)) {
+			memcpy(&size, header + sizeof(entry_magic), sizeof(size));
+
+			if (memcmp(header, entry_magic, sizeof(entry_magic)) == 0 && static_cast<uint64_t>(info.st_size) == header_size + size) {
+				code.resize(size);
+				hit = pread(fd, code.data(), size, header_size) == static_cast<ssize_t>(size);
+			}
+		}
+
+		// The modification time doubles as the last use for eviction
+		if (hit)
+			futimens(fd, nullptr);
+
+		close(fd);
+	}
+
+	update_stats([hit](Stats& stats) { (hit ? stats.hits : stats.misses)++; });
+
+	return hit;
+}
+
+void Cache::store(const Key& key, std::span<const uint8_t> code)
+{
+	std::string final_path = path(key);
+	std::string temp_path = m_dir + "/" + std::string(temp_prefix) + std::to_string(getpid()) + "." + std::to_string(m_temp_count++);
+
+	int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+
+	if (fd < 0)
+		return;
+
+	uint64_t size = code.size();
+	iovec parts[] = {
+		{ .iov_base = const_cast<char*>(entry_magic), .iov_len = sizeof(entry_magic) },
+		{ .iov_base = &size, .iov_len = sizeof(size) },
+		{ .iov_base = const_cast<uint8_t*>(code.data()), .iov_len = code.size() },
+	};
+
+	bool ok = writev(fd, parts, 3) == static_cast<ssize_t>(header_size + size);
+	ok = close(fd) == 0 && ok;
+
+	// Another process may have stored the same entry in the meantime,
+	// it is identical so either copy can win the rename
+	struct stat info {};
+	bool replaced = stat(final_path.c_str(), &info) == 0;
+
+	if (!ok || rename(temp_path.c_str(), final_path.c_str()) != 0) {
+		unlink(temp_path.c_str());
+		return;
+	}
+
+	update_stats([&](Stats& stats) {
+		stats.stores++;
+
+		if (!replaced)
+			stats.bytes += header_size + size;
+
+		if (stats.bytes > m_limit)
+			evict(stats);
+	});
+}
+
+Cache::Stats Cache::stats() const
+{
+	Stats stats;
+	int fd = open((m_dir + "/" + std::string(stats_name)).c_str(), O_RDONLY | O_CLOEXEC);
+
+	if (fd >= 0) {
+		if (pread(fd, &stats, sizeof(stats), 0) != sizeof(stats))
+			stats = {};
+
+		close(fd);
+	}
+
+	return stats;
+}
+
+std::string Cache::path(const Key& key) const
+{
+	constexpr char digits[] = "0123456789abcdef";
+	std::string path = m_dir + "/";
+
+	for (uint64_t half : { key.high, key.low }) {
+		for (int shift = 60; shift >= 0; shift -= 4)
+			path += digits[(half >> shift) & 0xF];
+	}
+
+	return path;
+}
+
+template <typename Update>
+Cache::Stats Cache::update_stats(Update update)
+{
+	FileLock lock(m_dir + "/" + std::string(stats_name));
+	Stats stats;
+
+	if (lock.fd() < 0)
+		return stats;
+
+	if (pread(lock.fd(), &stats, sizeof(stats), 0) != sizeof(stats))
+		stats = {};
+
+	update(stats);
+	pwrite(lock.fd(), &stats, sizeof(stats), 0);
+
+	return stats;
+}
+
+void Cache::evict(Stats& stats)
+{
+	struct Entry {
+		timespec used;
+		uint64_t size;
+		std::string name;
+	};
+
+	DIR* dir = opendir(m_dir.c_str());
+
+	if (!dir)
+		return;
+
+	std::vector<Entry> entries;
+	uint64_t total = 0;
+
+	while (dirent* item = readdir(dir)) {
+		struct stat info {};
+
+		if (!is_entry_name(item->d_name) || fstatat(dirfd(dir), item->d_name, &info, 0) != 0)
+			continue;
+
+		entries.push_back({ .used = info.st_mtim, .size = static_cast<uint64_t>(info.st_size), .name = item->d_name });
+		total += info.st_size;
+	}
+
+	// Going down to three quarters of the limit leaves room for a run of
+	// stores before the directory has to be scanned again
+	uint64_t target = m_limit / 4 * 3;
+
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+		return a.used.tv_sec != b.used.tv_sec ? a.used.tv_sec < b.used.tv_sec : a.used.tv_nsec < b.used.tv_nsec;
+	});
+
+	for (const Entry& entry : entries) {
+		if (total <= target)
+			break;
+
+		if (unlinkat(dirfd(dir), entry.name.c_str(), 0) == 0) {
+			total -= entry.size;
+			stats.evictions++;
+		}
+	}
+
+	closedir(dir);
+	stats.bytes = total;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lgn
+{
+	// Persistent store of compiled machine code, addressed by a hash of
+	// what it was compiled from: the source bytes, the compiler binary and
+	// the options that change the output. Any number of processes and
+	// threads may share a directory. Entries are written to a temporary
+	// file and renamed into place, so readers see a whole entry or none,
+	// and the shared counters are updated under a file lock. A hit bumps
+	// the entry's modification time, and once the entries outgrow the
+	// limit the least recently used ones are deleted.
+	class Cache
+	{
+	public:
+		static constexpr uint64_t default_limit = 256ull << 20;
+
+		struct Key {
+			uint64_t high;
+			uint64_t low;
+		};
+
+		struct Stats {
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			uint64_t stores = 0;
+			uint64_t evictions = 0;
+			// Size of all entries on disk
+			uint64_t bytes = 0;
+		};
+
+		Cache(std::string directory, uint64_t limit = default_limit);
+
+		// LGN_CACHE_DIR, or lgn under XDG_CACHE_HOME or ~/.cache
+		static std::string default_directory();
+
+		inline bool is_open() const { return m_open; }
+		inline const std::string& directory() const { return m_dir; }
+		inline uint64_t limit() const { return m_limit; }
+
+		Key key(std::string_view source, std::string_view options) const;
+
+		// Fills code and returns true when there is an entry for key
+		bool load(const Key& key, std::vector<uint8_t>& code);
+		void store(const Key& key, std::span<const uint8_t> code);
+
+		// Counters shared by everything that used the directory
+		Stats stats() const;
+
+	private:
+		std::string m_dir;
+		uint64_t m_limit;
+		// Hash of the running compiler, so a rebuilt lgn never sees old entries
+		uint64_t m_compiler = 0;
+		bool m_open = false;
+
+		std::atomic<uint64_t> m_temp_count = 0;
+
+		std::string path(const Key& key) const;
+
+		template <typename Update>
+		Stats update_stats(Update update);
+
+		// Deletes the oldest entries until they fit well under the limit,
+		// called with the stats lock held
+		void evict(Stats& stats);
+	};
+}
@@ -0,0 +1,448 @@
+#include "Compiler.h"
+#include "SourceFile.h"
+#include "Lexer.h"
+#include "ParallelLexer.h"
+#include "Parser.h"
+#include "Optimizer.h"
+#include "Resolver.h"
+#include "Assembler.h"
+#include "Peephole.h"
+#include "ParallelCodegen.h"
+#include "Elf.h"
+#include "Jit.h"
+#include "Vm.h"
+#include <cerrno>
+#include <csignal>
+#include <initializer_list>
+#include <thread>
+#include <utility>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace lgn;
+
+namespace
+{
+	// One write per line, so lines from parallel jobs don't interleave
+	void report(const Options& options, const std::string& input, const std::string& line)
+	{
+		*options.log << (options.batch ? input + ": " + line + "\n" : line + "\n");
+	}
+
+	// Runs fn as one phase of the compilation of input
+	template <typename Fn>
+	auto measure(Profiler* profiler, std::string_view phase, const std::string& input, Fn fn)
+	{
+		Profiler::Scope scope(profiler, phase, input);
+		return fn();
+	}
+
+	// Owns the file the output buffer writes to, so a compile error in
+	// the middle of writing neither leaks the descriptor nor leaves the
+	// buffer bound to it
+	class OutputFile
+	{
+	public:
+		OutputFile(OutputBuffer& out, int fd) : m_out(out), m_fd(fd) { m_out.reset(fd); }
+
+		OutputFile(const OutputFile& other) = delete;
+		OutputFile& operator=(const OutputFile& other) = delete;
+
+		~OutputFile()
+		{
+			if (m_fd >= 0) {
+				m_out.reset(-1);
+				::close(m_fd);
+			}
+		}
+
+		// Writes out what is buffered and closes the file, false if any
+		// write failed. size is set to the bytes written.
+		bool close(uint64_t& size)
+		{
+			bool written = m_out.flush();
+			m_out.reset(-1);
+			size = written ? lseek(m_fd, 0, SEEK_CUR) : 0;
+
+			return ::close(std::exchange(m_fd, -1)) == 0 && written;
+		}
+
+	private:
+		OutputBuffer& m_out;
+		int m_fd;
+	};
+
+	// Runs a program from PATH with args, without a shell, so paths reach
+	// it as they are. Returns whether it exited with status 0.
+	bool run_tool(std::initializer_list<std::string> args)
+	{
+		std::vector<char*> argv;
+
+		for (const std::string& arg : args)
+			argv.push_back(const_cast<char*>(arg.c_str()));
+
+		argv.push_back(nullptr);
+
+		pid_t pid;
+
+		if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0)
+			return false;
+
+		int status;
+
+		while (waitpid(pid, &status, 0) < 0) {
+			if (errno != EINTR)
+				return false;
+		}
+
+		return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+
+	// A path that starts with '-' would be taken for an option
+	std::string operand(const std::string& path)
+	{
+		return path.starts_with('-') ? "./" + path : path;
+	}
+
+	// Runs code generation into the sink, through the peephole pass when optimizing
+	void generate(Assembler& assembler, x86::InstrSink& sink, const Options& options, const std::string& input)
+	{
+		if (options.opt_level < 1) {
+			assembler.assemble(sink);
+			return;
+		}
+
+		Peephole peephole(sink);
+		assembler.assemble(peephole);
+
+		if (options.verbose) {
+			report(options, input, "peephole: removed " + std::to_string(peephole.removed()) + " instructions, rewrote "
+				+ std::to_string(peephole.rewritten()));
+		}
+	}
+
+	// Reports what generate() does for the same program
+	void report_parallel(const ParallelCodegen& codegen, const Options& options, const std::string& input)
+	{
+		if (options.opt_level >= 1 && options.verbose) {
+			report(options, input, "peephole: removed " + std::to_string(codegen.removed()) + " instructions, rewrote "
+				+ std::to_string(codegen.rewritten()));
+		}
+	}
+}
+
+int Compiler::compile(const std::string& input)
+{
+	SourceFile source(resolve(input).c_str());
+
+	if (!source.is_open())
+		throw std::runtime_error("Unable to open '" + input + "'");
+
+	return compile(input, source.view());
+}
+
+int Compiler::compile(const std::string& input, std::string_view source)
+{
+	Profiler::Scope total(m_profiler, "compile", input);
+	std::string stem = output_stem(input);
+
+	if (m_options.vm) {
+		compile_bytecode(source, input, total.counters());
+
+		vm::Machine machine;
+		vm::Result result = measure(m_profiler, "run", input, [&] { return machine.run(m_bytecode); });
+
+		// Die the way the native code would, so exit statuses compare equal
+		if (result.divided_by_zero)
+			raise(SIGFPE);
+
+		return static_cast<int>(result.value & 0xFF);
+	}
+
+	// Entries hold what the encoder produces, --nasm always runs the tools
+	bool use_cache = m_cache && (m_options.run || !m_options.use_nasm);
+	Cache::Key key {};
+
+	if (use_cache) {
+		bool hit = measure(m_profiler, "cache", input, [&] {
+			key = m_cache->key(source, cache_options());
+			return m_cache->load(key, m_cached);
+		});
+
+		if (m_options.verbose)
+			report(m_options, input, hit ? "cache: hit" : "cache: miss");
+
+		if (hit) {
+			total.counters().output_bytes = m_cached.size();
+			return write_output(m_cached, input, stem);
+		}
+	}
+
+	if (m_options.use_nasm && !m_options.run) {
+		flat::Ast ast = front_end(source, input, total.counters());
+
+		std::string asm_path = stem + ".asm";
+		int fd = open(asm_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+		if (fd < 0)
+			throw std::runtime_error("Unable to write '" + asm_path + "'");
+
+		OutputFile asm_file(m_output, fd);
+
+		// Formatting and writing the text are interleaved, so both count as codegen
+		if (m_options.codegen_threads > 1) {
+			ParallelCodegen codegen(ast, Assembler::Target::executable, m_options.opt_level >= 1, codegen_pool());
+
+			measure(m_profiler, "codegen", input, [&] { codegen.generate(m_output); });
+			report_parallel(codegen, m_options, input);
+			total.counters().instructions = codegen.emitted();
+		} else {
+			Assembler assembler(ast);
+
+			measure(m_profiler, "codegen", input, [&] {
+				x86::AsmWriter writer(m_output);
+				generate(assembler, writer, m_options, input);
+			});
+			total.counters().instructions = assembler.emitted();
+		}
+
+		if (!asm_file.close(total.counters().output_bytes))
+			throw std::runtime_error("Unable to write '" + asm_path + "'");
+
+		std::string object_path = operand(stem + ".o");
+
+		if (!measure(m_profiler, "nasm", input, [&] { return run_tool({ "nasm", "-felf64", operand(asm_path), "-o", object_path }); })
+			|| !measure(m_profiler, "ld", input, [&] { return run_tool({ "ld", object_path, "-o", operand(stem + ".exe") }); }))
+			throw std::runtime_error("Unable to assemble '" + asm_path + "'");
+
+		return EXIT_SUCCESS;
+	}
+
+	std::span<const uint8_t> code = build(source, input, total.counters());
+
+	if (use_cache)
+		measure(m_profiler, "cache", input, [&] { m_cache->store(key, code); });
+
+	return write_output(code, input, stem);
+}
+
+std::span<const uint8_t> Compiler::compile_code(std::string_view source)
+{
+	Profiler::Counters counters;
+	return build(source, "<source>", counters);
+}
+
+const vm::Program& Compiler::compile_bytecode(std::string_view source)
+{
+	Profiler::Counters counters;
+	return compile_bytecode(source, "<source>", counters);
+}
+
+const vm::Program& Compiler::compile_bytecode(std::string_view source, const std::string& input, Profiler::Counters& counters)
+{
+	flat::Ast ast = front_end(source, input, counters);
+
+	measure(m_profiler, "bytecode", input, [&] { vm::compile(ast, m_bytecode); });
+	counters.instructions = m_bytecode.code.size();
+	counters.output_bytes = m_bytecode.code.size() * sizeof(vm::Instr) + m_bytecode.constants.size() * sizeof(uint64_t);
+
+	return m_bytecode;
+}
+
+// The parser pulls tokens from the lexer as it needs them, so lexing is
+// part of the "parse" phase, as is reading a mapped source from disk. A
+// lexer error anywhere in the input wins over a parser error, as it would
+// if the whole input were lexed first.
+void Compiler::parse(std::string_view source, flat::Ast& ast, const std::string& input, Profiler::Counters& counters)
+{
+	Lexer lexer(source, m_interner);
+	Parser parser(lexer, ast);
+
+	try {
+		measure(m_profiler, "parse", input, [&] { parser.parse(); });
+	} catch (const CompileError&) {
+		Token token;
+
+		while (lexer.next(token)) {}
+
+		throw;
+	}
+
+	counters.tokens = lexer.count();
+}
+
+// The lexer fills a ring on its own thread while the parser empties it, so
+// parsing starts with the first tokens and the tokens in memory are bounded
+// by the ring. Errors come out as they would sequentially: a lexer error
+// wins over a parser error, since the lexer would have seen it first.
+void Compiler::parse_pipelined(std::string_view source, flat::Ast& ast, const std::string& input, Profiler::Counters& counters)
+{
+	TokenRing ring;
+
+	std::thread lexer_thread([&] {
+		try {
+			measure(m_profiler, "lex", input, [&] {
+				Lexer lexer(source, m_interner);
+				counters.tokens = lexer.tokenize(ring);
+			});
+			ring.close();
+		} catch (...) {
+			ring.fail(std::current_exception());
+		}
+	});
+
+	try {
+		measure(m_profiler, "parse", input, [&] {
+			Parser parser(ring, ast);
+			parser.parse();
+		});
+	} catch (...) {
+		// The lexer goes on to the end of the input, dropping its tokens
+		ring.cancel();
+		lexer_thread.join();
+
+		if (ring.error())
+			std::rethrow_exception(ring.error());
+
+		throw;
+	}
+
+	lexer_thread.join();
+}
+
+// The whole source is lexed on the pool before parsing starts. Lexer
+// errors still win, parsing never begins with one.
+void Compiler::parse_parallel(std::string_view source, flat::Ast& ast, const std::string& input, Profiler::Counters& counters)
+{
+	if (!m_lex_pool)
+		m_lex_pool = std::make_unique<ThreadPool>(m_options.lex_threads);
+
+	ParallelLexer lexer(source, m_interner, *m_lex_pool);
+
+	measure(m_profiler, "lex", input, [&] { lexer.tokenize(); });
+	counters.tokens = lexer.count();
+
+	measure(m_profiler, "parse", input, [&] {
+		Parser parser(lexer, ast);
+		parser.parse();
+	});
+}
+
+flat::Ast Compiler::front_end(std::string_view source, const std::string& input, Profiler::Counters& counters)
+{
+	m_interner.clear();
+
+	flat::Ast ast;
+
+	if (m_options.lex_threads > 1)
+		parse_parallel(source, ast, input, counters);
+	else if (m_options.pipeline)
+		parse_pipelined(source, ast, input, counters);
+	else
+		parse(source, ast, input, counters);
+
+	// Names are checked before the optimizer can remove code, so every
+	// level reports the same errors
+	Resolver resolver(m_interner);
+	measure(m_profiler, "check", input, [&] { resolver.check(ast); });
+	counters.ast_bytes = ast.bytes();
+
+	measure(m_profiler, "optimize", input, [&] {
+		Optimizer optimizer(ast, m_options.opt_level);
+		optimizer.optimize();
+	});
+	counters.nodes = ast.size();
+
+	measure(m_profiler, "resolve", input, [&] { resolver.resolve(ast); });
+
+	return ast;
+}
+
+std::span<const uint8_t> Compiler::build(std::string_view source, const std::string& input, Profiler::Counters& counters)
+{
+	flat::Ast ast = front_end(source, input, counters);
+	Assembler::Target target = m_options.run ? Assembler::Target::function : Assembler::Target::executable;
+
+	if (m_options.codegen_threads > 1) {
+		ParallelCodegen codegen(ast, target, m_options.opt_level >= 1, codegen_pool());
+
+		measure(m_profiler, "codegen", input, [&] { codegen.generate(m_code); });
+		report_parallel(codegen, m_options, input);
+		counters.instructions = codegen.emitted();
+		counters.output_bytes = m_code.size();
+
+		return m_code;
+	}
+
+	Assembler assembler(ast, target);
+
+	m_encoder.reset();
+
+	measure(m_profiler, "codegen", input, [&] {
+		generate(assembler, m_encoder, m_options, input);
+	});
+	counters.instructions = assembler.emitted();
+	counters.output_bytes = m_encoder.bytes().size();
+
+	return m_encoder.bytes();
+}
+
+ThreadPool& Compiler::codegen_pool()
+{
+	if (!m_codegen_pool)
+		m_codegen_pool = std::make_unique<ThreadPool>(m_options.codegen_threads);
+
+	return *m_codegen_pool;
+}
+
+int Compiler::write_output(std::span<const uint8_t> code, const std::string& input, const std::string& stem)
+{
+	if (m_options.run) {
+		int status = measure(m_profiler, "run", input, [&] { return jit::run(code); });
+
+		if (status < 0)
+			throw std::runtime_error("Unable to map executable memory");
+
+		return status;
+	}
+
+	if (!measure(m_profiler, "write", input, [&] { return elf::write_executable((stem + ".exe").c_str(), code); }))
+		throw std::runtime_error("Unable to write '" + stem + ".exe'");
+
+	return EXIT_SUCCESS;
+}
+
+// Everything besides the source that changes the generated code
+std::string Compiler::cache_options() const
+{
+	return "O" + std::to_string(m_options.opt_level) + (m_options.run ? " function" : " executable");
+}
+
+std::string Compiler::output_path(const std::string& input) const
+{
+	return output_stem(input) + ".exe";
+}
+
+std::string Compiler::resolve(const std::string& path) const
+{
+	if (m_options.directory.empty() || path.starts_with('/'))
+		return path;
+
+	return m_options.directory + "/" + path;
+}
+
+std::string Compiler::output_stem(const std::string& input) const
+{
+	if (!m_options.batch)
+		return resolve("out");
+
+	// Drop the extension of the file name, not of a directory
+	size_t slash = input.find_last_of('/');
+	size_t dot = input.find_last_of('.');
+
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash) || dot == slash + 1)
+		return resolve(input);
+
+	return resolve(input.substr(0, dot));
+}
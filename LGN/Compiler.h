@@ -0,0 +1,102 @@
+#pragma once
+#include "Bytecode.h"
+#include "Cache.h"
+#include "Encoder.h"
+#include "FlatAst.h"
+#include "Interner.h"
+#include "OutputBuffer.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace lgn
+{
+	struct Options {
+		int opt_level = 0;
+		bool verbose = false;
+		bool use_nasm = false;
+		bool run = false;
+		// Run on the bytecode VM instead of compiling to machine code
+		bool vm = false;
+		// Lex on a second thread while parsing
+		bool pipeline = false;
+		// Lex on this many threads before parsing, for very large inputs.
+		// Takes precedence over pipeline.
+		size_t lex_threads = 1;
+		// Generate the code of the top-level statements on this many threads
+		size_t codegen_threads = 1;
+
+		// Several inputs at once: outputs are named after their input
+		// instead of out.*, and reports are prefixed with the input name
+		bool batch = false;
+
+		// Relative inputs and outputs are taken from here instead of the
+		// working directory when set
+		std::string directory {};
+		// Where -v reports go
+		std::ostream* log = &std::cerr;
+	};
+
+	// Takes one input at a time through the whole pipeline. The interner,
+	// the encoder and the output buffer are kept from one input to the
+	// next, so a worker compiling a batch of files sets them up once and
+	// only the Ast is allocated again for each. With a cache, a source
+	// compiled before with the same options goes straight from reading the
+	// file to writing its output. Errors in the program are thrown as
+	// CompileError, I/O failures as std::runtime_error; neither leaves
+	// anything behind that would affect the next compile().
+	class Compiler
+	{
+	public:
+		explicit Compiler(const Options& options, Cache* cache = nullptr, Profiler* profiler = nullptr)
+			: m_options(options), m_cache(cache), m_profiler(profiler) {}
+
+		// Returns the program's exit code with --run or --vm, EXIT_SUCCESS otherwise
+		int compile(const std::string& input);
+
+		// The same for source that was not read from input
+		int compile(const std::string& input, std::string_view source);
+
+		// Machine code for source, for the target the options select,
+		// without touching the cache or writing anything. Stays valid until
+		// the next call.
+		std::span<const uint8_t> compile_code(std::string_view source);
+
+		// The same for the bytecode VM
+		const vm::Program& compile_bytecode(std::string_view source);
+
+		// Where compile() writes the executable for input
+		std::string output_path(const std::string& input) const;
+
+		inline void set_cache(Cache* cache) { m_cache = cache; }
+
+	private:
+		const Options& m_options;
+		Cache* m_cache;
+		Profiler* m_profiler;
+
+		Interner m_interner {};
+		x86::Encoder m_encoder {};
+		OutputBuffer m_output { -1 };
+		std::vector<uint8_t> m_cached {};
+		std::vector<uint8_t> m_code {};
+		vm::Program m_bytecode {};
+		std::unique_ptr<ThreadPool> m_lex_pool {};
+		std::unique_ptr<ThreadPool> m_codegen_pool {};
+
+		void parse(std::string_view source, flat::Ast& ast, const std::string& input, Profiler::Counters& counters);
+		void parse_pipelined(std::string_view source, flat::Ast& ast, const std::string& input, Profiler::Counters& counters);
+		void parse_parallel(std::string_view source, flat::Ast& ast, const std::string& input, Profiler::Counters& counters);
+		ThreadPool& codegen_pool();
+		flat::Ast front_end(std::string_view source, const std::string& input, Profiler::Counters& counters);
+		std::span<const uint8_t> build(std::string_view source, const std::string& input, Profiler::Counters& counters);
+		const vm::Program& compile_bytecode(std::string_view source, const std::string& input, Profiler::Counters& counters);
+		int write_output(std::span<const uint8_t> code, const std::string& input, const std::string& stem);
+		std::string output_stem(const std::string& input) const;
+		std::string resolve(const std::string& path) const;
+		std::string cache_options() const;
+	};
+}
@@ -0,0 +1,59 @@
+#include "Elf.h"
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+using namespace lgn;
+
+bool elf::write_executable(const char* path, std::span<const uint8_t> code)
+{
+	constexpr uint64_t headers_size = sizeof(Elf64_Ehdr) + sizeof(Elf64_Phdr);
+
+	Elf64_Ehdr header {};
+	memcpy(header.e_ident, ELFMAG, SELFMAG);
+	header.e_ident[EI_CLASS] = ELFCLASS64;
+	header.e_ident[EI_DATA] = ELFDATA2LSB;
+	header.e_ident[EI_VERSION] = EV_CURRENT;
+	header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+	header.e_type = ET_EXEC;
+	header.e_machine = EM_X86_64;
+	header.e_version = EV_CURRENT;
+	header.e_entry = base_address + headers_size;
+	header.e_phoff = sizeof(Elf64_Ehdr);
+	header.e_ehsize = sizeof(Elf64_Ehdr);
+	header.e_phentsize = sizeof(Elf64_Phdr);
+	header.e_phnum = 1;
+
+	// The whole file is mapped from offset 0, which keeps the segment
+	// offset and address congruent modulo the page size.
+	Elf64_Phdr segment {};
+	segment.p_type = PT_LOAD;
+	segment.p_flags = PF_R | PF_X;
+	segment.p_offset = 0;
+	segment.p_vaddr = base_address;
+	segment.p_paddr = base_address;
+	segment.p_filesz = headers_size + code.size();
+	segment.p_memsz = segment.p_filesz;
+	segment.p_align = 0x1000;
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0755);
+
+	if (fd < 0)
+		return false;
+
+	iovec parts[] = {
+		{ .iov_base = &header, .iov_len = sizeof(header) },
+		{ .iov_base = &segment, .iov_len = sizeof(segment) },
+		{ .iov_base = const_cast<uint8_t*>(code.data()), .iov_len = code.size() },
+	};
+
+	ssize_t written = writev(fd, parts, 3);
+	bool ok = written == static_cast<ssize_t>(headers_size + code.size());
+
+	// O_CREAT only applies the mode to new files
+	ok = fchmod(fd, 0755) == 0 && ok;
+
+	return close(fd) == 0 && ok;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+#include <span>
+
+namespace lgn::elf
+{
+	// Address the program is loaded at, the same default ld uses
+	constexpr uint64_t base_address = 0x400000;
+
+	// Writes a static ELF64 executable whose only segment holds the headers
+	// followed by the code, with the entry point at the first code byte.
+	bool write_executable(const char* path, std::span<const uint8_t> code);
+}
@@ -0,0 +1,266 @@
+#include "Encoder.h"
+#include "Error.h"
+#include <algorithm>
+using namespace lgn;
+using namespace lgn::x86;
+
+namespace
+{
+	inline uint8_t low3(Reg reg)
+	{
+		return static_cast<uint8_t>(reg) & 7;
+	}
+
+	inline uint8_t high1(Reg reg)
+	{
+		return static_cast<uint8_t>(reg) >> 3;
+	}
+
+	inline bool fits_int8(uint64_t value)
+	{
+		auto signed_value = static_cast<int64_t>(value);
+		return signed_value >= INT8_MIN && signed_value <= INT8_MAX;
+	}
+
+	inline bool fits_int32(uint64_t value)
+	{
+		auto signed_value = static_cast<int64_t>(value);
+		return signed_value >= INT32_MIN && signed_value <= INT32_MAX;
+	}
+
+	[[noreturn]] void unencodable(const Instr& instr)
+	{
+		throw CompileError("Unable to encode instruction: " + to_string(instr));
+	}
+}
+
+void Encoder::encode(std::span<const Instr> code)
+{
+	write(code);
+	finish();
+}
+
+void Encoder::reset(uint64_t label_base)
+{
+	m_label_base = label_base;
+	m_bytes.clear();
+	m_labels.clear();
+	m_fixups.clear();
+}
+
+void Encoder::write(std::span<const Instr> code)
+{
+	// Growing to exactly what this chunk needs would copy the whole
+	// program once per top-level statement
+	size_t needed = m_bytes.size() + code.size() * 4;
+
+	if (needed > m_bytes.capacity())
+		m_bytes.reserve(std::max(needed, m_bytes.capacity() * 2));
+
+	for (const Instr& instr : code)
+		encode_instr(instr);
+}
+
+void Encoder::finish()
+{
+	for (const Fixup& fixup : m_fixups) {
+		uint64_t label = fixup.label - m_label_base;
+
+		if (fixup.label < m_label_base || label >= m_labels.size() || m_labels[label] < 0) {
+			throw CompileError("Jump to undefined label_" + std::to_string(fixup.label));
+		}
+
+		auto rel = static_cast<int32_t>(m_labels[label] - static_cast<int64_t>(fixup.pos + 4));
+
+		for (int i = 0; i < 4; i++)
+			m_bytes[fixup.pos + i] = static_cast<uint8_t>(static_cast<uint32_t>(rel) >> (i * 8));
+	}
+
+	m_fixups.clear();
+}
+
+void Encoder::encode_instr(const Instr& instr)
+{
+	const Operand& dst = instr.dst;
+	const Operand& src = instr.src;
+
+	switch (instr.op) {
+	case Op::label:
+		if (dst.value < m_label_base)
+			unencodable(instr);
+
+		if (dst.value - m_label_base >= m_labels.size())
+			m_labels.resize(dst.value - m_label_base + 1, -1);
+
+		m_labels[dst.value - m_label_base] = static_cast<int64_t>(m_bytes.size());
+		break;
+	case Op::push:
+		if (dst.is_reg()) {
+			rex(false, Reg::rax, dst.reg);
+			byte(0x50 + low3(dst.reg));
+		} else if (dst.kind == Operand::Kind::mem) {
+			rex(false, Reg::rax, dst.reg);
+			byte(0xFF);
+			modrm_mem(6, dst.reg, dst.value);
+		} else if (dst.is_imm() && fits_int32(dst.value)) {
+			byte(0x68);
+			imm32(static_cast<uint32_t>(dst.value));
+		} else {
+			unencodable(instr);
+		}
+		break;
+	case Op::pop:
+		rex(false, Reg::rax, dst.reg);
+		byte(0x58 + low3(dst.reg));
+		break;
+	case Op::mov:
+		if (src.is_reg()) {
+			reg_reg(0x89, src.reg, dst.reg);
+		} else if (src.kind == Operand::Kind::mem) {
+			rex(true, dst.reg, src.reg);
+			byte(0x8B);
+			modrm_mem(low3(dst.reg), src.reg, src.value);
+		} else if (src.value <= UINT32_MAX) {
+			// Writing the 32-bit register clears the upper half
+			rex(false, Reg::rax, dst.reg);
+			byte(0xB8 + low3(dst.reg));
+			imm32(static_cast<uint32_t>(src.value));
+		} else if (fits_int32(src.value)) {
+			rex(true, Reg::rax, dst.reg);
+			byte(0xC7);
+			modrm_reg(0, dst.reg);
+			imm32(static_cast<uint32_t>(src.value));
+		} else {
+			rex(true, Reg::rax, dst.reg);
+			byte(0xB8 + low3(dst.reg));
+			imm64(src.value);
+		}
+		break;
+	case Op::add:
+	case Op::sub:
+		if (src.is_reg())
+			reg_reg(instr.op == Op::add ? 0x01 : 0x29, src.reg, dst.reg);
+		else if (src.is_imm() && fits_int32(src.value))
+			alu_imm(instr.op == Op::add ? 0 : 5, dst.reg, src.value);
+		else
+			unencodable(instr);
+		break;
+	case Op::imul:
+		rex(true, dst.reg, src.reg);
+		byte(0x0F);
+		byte(0xAF);
+		modrm_reg(low3(dst.reg), src.reg);
+		break;
+	case Op::div:
+		rex(true, Reg::rax, dst.reg);
+		byte(0xF7);
+		modrm_reg(6, dst.reg);
+		break;
+	case Op::xor_:
+		reg_reg(0x31, src.reg, dst.reg, false);
+		break;
+	case Op::test:
+		reg_reg(0x85, src.reg, dst.reg);
+		break;
+	case Op::jz:
+		byte(0x0F);
+		byte(0x84);
+		jump(dst);
+		break;
+	case Op::jmp:
+		byte(0xE9);
+		jump(dst);
+		break;
+	case Op::syscall:
+		byte(0x0F);
+		byte(0x05);
+		break;
+	case Op::ret:
+		byte(0xC3);
+		break;
+	}
+}
+
+void Encoder::byte(uint8_t value)
+{
+	m_bytes.push_back(value);
+}
+
+void Encoder::imm32(uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+		byte(static_cast<uint8_t>(value >> (i * 8)));
+}
+
+void Encoder::imm64(uint64_t value)
+{
+	for (int i = 0; i < 8; i++)
+		byte(static_cast<uint8_t>(value >> (i * 8)));
+}
+
+void Encoder::rex(bool wide, Reg reg, Reg rm)
+{
+	uint8_t prefix = 0x40 | (wide << 3) | (high1(reg) << 2) | high1(rm);
+
+	if (prefix != 0x40)
+		byte(prefix);
+}
+
+void Encoder::modrm_reg(uint8_t reg, Reg rm)
+{
+	byte(0xC0 | (reg << 3) | low3(rm));
+}
+
+// [base + disp] with no index register. rsp and r12 as a base always need
+// a SIB byte, rbp and r13 cannot use the displacement-free form.
+void Encoder::modrm_mem(uint8_t reg, Reg base, uint64_t disp)
+{
+	if (!fits_int32(disp)) {
+		throw CompileError("Stack offset " + std::to_string(disp) + " does not fit in 32 bits");
+	}
+
+	uint8_t mod = 0x80;
+
+	if (disp == 0 && low3(base) != 5)
+		mod = 0x00;
+	else if (fits_int8(disp))
+		mod = 0x40;
+
+	byte(mod | (reg << 3) | low3(base));
+
+	if (low3(base) == 4)
+		byte(0x24);
+
+	if (mod == 0x40)
+		byte(static_cast<uint8_t>(disp));
+	else if (mod == 0x80)
+		imm32(static_cast<uint32_t>(disp));
+}
+
+void Encoder::reg_reg(uint8_t opcode, Reg reg, Reg rm, bool wide)
+{
+	rex(wide, reg, rm);
+	byte(opcode);
+	modrm_reg(low3(reg), rm);
+}
+
+void Encoder::alu_imm(uint8_t ext, Reg dst, uint64_t value)
+{
+	rex(true, Reg::rax, dst);
+
+	if (fits_int8(value)) {
+		byte(0x83);
+		modrm_reg(ext, dst);
+		byte(static_cast<uint8_t>(value));
+	} else {
+		byte(0x81);
+		modrm_reg(ext, dst);
+		imm32(static_cast<uint32_t>(value));
+	}
+}
+
+void Encoder::jump(const Operand& target)
+{
+	m_fixups.push_back({ .pos = m_bytes.size(), .label = target.value });
+	imm32(0);
+}
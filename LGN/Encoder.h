@@ -0,0 +1,53 @@
+#pragma once
+#include "Instr.h"
+#include <cstdint>
+#include <vector>
+
+namespace lgn::x86
+{
+	// Translates instructions straight into x86-64 machine code. Jumps are
+	// emitted with 32-bit displacements and patched in finish(), once every
+	// label position is known.
+	class Encoder : public InstrSink
+	{
+	public:
+		void write(std::span<const Instr> code) override;
+		void finish() override;
+
+		// Encodes a complete program in one go
+		void encode(std::span<const Instr> code);
+
+		// Empties the encoder for the next program, keeping its buffers.
+		// Code that only uses labels from label_base on, like a part of a
+		// program, can start there.
+		void reset(uint64_t label_base = 0);
+
+		inline const std::vector<uint8_t>& bytes() const { return m_bytes; }
+
+	private:
+		struct Fixup {
+			size_t pos;
+			uint64_t label;
+		};
+
+		std::vector<uint8_t> m_bytes;
+		// Position of every label, from m_label_base on
+		std::vector<int64_t> m_labels;
+		uint64_t m_label_base = 0;
+		std::vector<Fixup> m_fixups;
+
+		void encode_instr(const Instr& instr);
+
+		void byte(uint8_t value);
+		void imm32(uint32_t value);
+		void imm64(uint64_t value);
+
+		void rex(bool wide, Reg reg, Reg rm);
+		void modrm_reg(uint8_t reg, Reg rm);
+		void modrm_mem(uint8_t reg, Reg base, uint64_t disp);
+
+		void reg_reg(uint8_t opcode, Reg reg, Reg rm, bool wide = true);
+		void alu_imm(uint8_t ext, Reg dst, uint64_t value);
+		void jump(const Operand& target);
+	};
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <stdexcept>
+#include <string>
+
+namespace lgn
+{
+	// Raised for anything wrong with the program being compiled. Only the
+	// current compilation is abandoned, so the driver can report it and go
+	// on with the next input.
+	class CompileError : public std::runtime_error
+	{
+	public:
+		using std::runtime_error::runtime_error;
+	};
+}
@@ -0,0 +1,158 @@
+#include "FlatAst.h"
+using namespace lgn;
+using namespace lgn::flat;
+
+Index Ast::add_node(Kind kind, Index a, Index b)
+{
+	m_kinds.push_back(kind);
+	m_lhs.push_back(a);
+	m_rhs.push_back(b);
+
+	return static_cast<Index>(m_kinds.size() - 1);
+}
+
+Index Ast::add_value(uint64_t value)
+{
+	m_values.push_back(value);
+
+	return static_cast<Index>(m_values.size() - 1);
+}
+
+Index Ast::add_scope(std::span<const Index> statements)
+{
+	Index begin = static_cast<Index>(m_lists.size());
+	m_lists.insert(m_lists.end(), statements.begin(), statements.end());
+
+	return add_node(Kind::scope, begin, static_cast<Index>(statements.size()));
+}
+
+size_t Ast::bytes() const
+{
+	return m_kinds.capacity() * sizeof(Kind) + (m_lhs.capacity() + m_rhs.capacity() + m_lists.capacity()) * sizeof(Index)
+		+ m_values.capacity() * sizeof(uint64_t);
+}
+
+Index Ast::add_copy(const Ast& from, Index node)
+{
+	Kind kind = from.kind(node);
+	Index a = from.lhs(node);
+	Index b = from.rhs(node);
+
+	switch (kind) {
+	case Kind::int_lit:
+		return add_node(kind, add_value(from.m_values[a]), b);
+	case Kind::var:
+		return add_node(kind, a);
+	case Kind::exit:
+	case Kind::let:
+		return add_node(kind, add_copy(from, a), b);
+	case Kind::if_:
+	{
+		Index expr = add_copy(from, a);
+		return add_node(kind, expr, add_copy(from, b));
+	}
+	case Kind::scope:
+	{
+		std::vector<Index> statements;
+		statements.reserve(b);
+
+		for (Index stmt : from.statements(node))
+			statements.push_back(add_copy(from, stmt));
+
+		return add_scope(statements);
+	}
+	default:
+	{
+		Index left = add_copy(from, a);
+		return add_node(kind, left, add_copy(from, b));
+	}
+	}
+}
+
+void Ast::compact()
+{
+	constexpr Index unused = UINT32_MAX;
+	std::vector<Index> moved(m_kinds.size(), unused);
+
+	// Children come before their parents, so a backward pass from the root
+	// reaches every node still in use
+	moved[m_root] = 0;
+
+	for (size_t node = m_kinds.size(); node-- > 0;) {
+		if (moved[node] == unused)
+			continue;
+
+		switch (m_kinds[node]) {
+		case Kind::int_lit:
+		case Kind::var:
+			break;
+		case Kind::exit:
+		case Kind::let:
+			moved[m_lhs[node]] = 0;
+			break;
+		case Kind::scope:
+			for (Index stmt : statements(static_cast<Index>(node)))
+				moved[stmt] = 0;
+			break;
+		default:
+			moved[m_lhs[node]] = 0;
+			moved[m_rhs[node]] = 0;
+			break;
+		}
+	}
+
+	// Nodes and lists only move down, and a scope's list never lies before
+	// the lists of the scopes that come before it
+	Index count = 0;
+	Index list_count = 0;
+
+	for (Index node = 0; node < m_kinds.size(); node++) {
+		if (moved[node] == unused)
+			continue;
+
+		Kind kind = m_kinds[node];
+		Index a = m_lhs[node];
+		Index b = m_rhs[node];
+
+		switch (kind) {
+		case Kind::int_lit:
+		case Kind::var:
+			break;
+		case Kind::exit:
+		case Kind::let:
+			a = moved[a];
+			break;
+		case Kind::scope:
+			for (Index i = 0; i < b; i++)
+				m_lists[list_count + i] = moved[m_lists[a + i]];
+
+			a = list_count;
+			list_count += b;
+			break;
+		default:
+			a = moved[a];
+			b = moved[b];
+			break;
+		}
+
+		moved[node] = count;
+		set_node(count++, kind, a, b);
+	}
+
+	m_root = moved[m_root];
+	m_kinds.resize(count);
+	m_lhs.resize(count);
+	m_rhs.resize(count);
+	m_lists.resize(list_count);
+}
+
+void Ast::clear()
+{
+	m_kinds.clear();
+	m_lhs.clear();
+	m_rhs.clear();
+	m_values.clear();
+	m_lists.clear();
+	m_root = 0;
+	m_slot_count = 0;
+}
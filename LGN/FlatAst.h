@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace lgn::flat
+{
+	using Index = uint32_t;
+
+	// One tag per node, the meaning of the two operands depends on it.
+	enum class Kind : uint8_t {
+		int_lit,	// a: index into values, b: 1 + the symbol of its text if it does not fit in 64 bits
+		var,		// a: symbol, the variable's slot once resolved
+		add,		// a: left, b: right
+		sub,
+		mul,
+		div,
+		exit,		// a: expression
+		let,		// a: expression, b: symbol, the variable's slot once resolved
+		if_,		// a: expression, b: scope
+		scope,		// a: first entry in lists, b: statement count
+	};
+
+	// Struct-of-arrays AST, the only form of a program: the Parser writes
+	// it, the Optimizer rewrites it in place and the Resolver and code
+	// generators read it. Every node is a tag plus two 32-bit operands,
+	// children are indices into the same arrays and always come before
+	// their parents. Expressions are stored in post-order, so an expression
+	// occupies the contiguous range [first(root), root] and can be walked
+	// front to back. The statements of a scope are a range of lists, and
+	// the lists are in the order of their scope nodes.
+	class Ast {
+	public:
+		inline Kind kind(Index node) const { return m_kinds[node]; }
+		inline Index lhs(Index node) const { return m_lhs[node]; }
+		inline Index rhs(Index node) const { return m_rhs[node]; }
+
+		// Value of an int_lit node. Resolver::check() rejects the literals
+		// that do not fit in 64 bits before anything asks.
+		inline uint64_t literal(Index node) const { return m_values[m_lhs[node]]; }
+
+		inline std::span<const Index> statements(Index scope) const
+		{
+			return { m_lists.data() + m_lhs[scope], m_rhs[scope] };
+		}
+
+		inline std::span<Index> statements(Index scope)
+		{
+			return { m_lists.data() + m_lhs[scope], m_rhs[scope] };
+		}
+
+		// Leftmost leaf of an expression, i.e. where its post-order range begins
+		inline Index first(Index expr) const
+		{
+			while (m_kinds[expr] >= Kind::add && m_kinds[expr] <= Kind::div)
+				expr = m_lhs[expr];
+
+			return expr;
+		}
+
+		inline Index root() const { return m_root; }
+		inline size_t size() const { return m_kinds.size(); }
+
+		// Memory the arrays hold
+		size_t bytes() const;
+
+		// Number of distinct variables, valid once the Resolver has run
+		inline size_t slot_count() const { return m_slot_count; }
+
+		Index add_node(Kind kind, Index a = 0, Index b = 0);
+		Index add_value(uint64_t value);
+		Index add_scope(std::span<const Index> statements);
+		inline void set_root(Index scope) { m_root = scope; }
+		inline void set_node(Index node, Kind kind, Index a, Index b) { m_kinds[node] = kind; m_lhs[node] = a; m_rhs[node] = b; }
+		inline void set_operand(Index node, Index a, Index b) { m_lhs[node] = a; m_rhs[node] = b; }
+		inline void set_slot_count(size_t count) { m_slot_count = count; }
+
+		// Appends node of from with everything under it, in the same order
+		Index add_copy(const Ast& from, Index node);
+
+		// Drops the nodes the root no longer reaches after a rewrite and
+		// moves the others down, keeping their order, so expressions are
+		// contiguous again.
+		void compact();
+
+		// Empties the arrays, keeping their memory
+		void clear();
+
+	private:
+		std::vector<Kind> m_kinds;
+		std::vector<Index> m_lhs;
+		std::vector<Index> m_rhs;
+
+		std::vector<uint64_t> m_values;
+		std::vector<Index> m_lists;
+
+		Index m_root = 0;
+		size_t m_slot_count = 0;
+	};
+}
@@ -0,0 +1,96 @@
+#include "Hash.h"
+#include <bit>
+#include <cstring>
+using namespace lgn;
+
+namespace
+{
+	constexpr uint64_t prime1 = 11400714785074694791ull;
+	constexpr uint64_t prime2 = 14029467366897019727ull;
+	constexpr uint64_t prime3 = 1609587929392839161ull;
+	constexpr uint64_t prime4 = 9650029242287828579ull;
+	constexpr uint64_t prime5 = 2870177450012600261ull;
+
+	inline uint64_t read64(const char* p)
+	{
+		uint64_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	inline uint32_t read32(const char* p)
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	inline uint64_t round(uint64_t acc, uint64_t input)
+	{
+		acc += input * prime2;
+		acc = std::rotl(acc, 31);
+		return acc * prime1;
+	}
+
+	inline uint64_t merge_round(uint64_t acc, uint64_t value)
+	{
+		acc ^= round(0, value);
+		return acc * prime1 + prime4;
+	}
+}
+
+uint64_t lgn::hash64(std::string_view data, uint64_t seed)
+{
+	const char* p = data.data();
+	const char* end = p + data.size();
+	uint64_t h;
+
+	if (data.size() >= 32) {
+		uint64_t v1 = seed + prime1 + prime2;
+		uint64_t v2 = seed + prime2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - prime1;
+
+		// Four independent lanes over 32-byte stripes
+		for (; end - p >= 32; p += 32) {
+			v1 = round(v1, read64(p));
+			v2 = round(v2, read64(p + 8));
+			v3 = round(v3, read64(p + 16));
+			v4 = round(v4, read64(p + 24));
+		}
+
+		h = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) + std::rotl(v4, 18);
+		h = merge_round(h, v1);
+		h = merge_round(h, v2);
+		h = merge_round(h, v3);
+		h = merge_round(h, v4);
+	} else {
+		h = seed + prime5;
+	}
+
+	h += data.size();
+
+	for (; end - p >= 8; p += 8) {
+		h ^= round(0, read64(p));
+		h = std::rotl(h, 27) * prime1 + prime4;
+	}
+
+	if (end - p >= 4) {
+		h ^= read32(p) * prime1;
+		h = std::rotl(h, 23) * prime2 + prime3;
+		p += 4;
+	}
+
+	for (; p < end; p++) {
+		h ^= static_cast<uint8_t>(*p) * prime5;
+		h = std::rotl(h, 11) * prime1;
+	}
+
+	h ^= h >> 33;
+	h *= prime2;
+	h ^= h >> 29;
+	h *= prime3;
+	h ^= h >> 32;
+
+	return h;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+namespace lgn
+{
+	// XXH64, a non-cryptographic hash that runs at memory speed. Used to
+	// address cache entries by the content they were built from.
+	uint64_t hash64(std::string_view data, uint64_t seed = 0);
+}
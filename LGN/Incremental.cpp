@@ -0,0 +1,321 @@
+#include "Incremental.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "Optimizer.h"
+#include "Resolver.h"
+#include "Assembler.h"
+#include "Peephole.h"
+#include <algorithm>
+using namespace lgn;
+
+Incremental::Incremental(const Options& options)
+	: m_options(options), m_interner(&m_names), m_resolver(m_interner)
+{
+}
+
+std::span<const uint8_t> Incremental::build(std::string_view source)
+{
+	m_parsed.clear();
+	m_rebuilt = 0;
+
+	// update() only replaces statements once the new ones parsed, and
+	// every statement built keeps what it was built against, so a failure
+	// leaves a state the next build can start from
+	try {
+		update(source);
+		m_valid = true;
+		link();
+	} catch (...) {
+		for (Statement& statement : m_statements)
+			statement.ast.reset();
+
+		throw;
+	}
+
+	return m_image;
+}
+
+// Parses the statements an edit may have changed, from the start of the
+// first statement at or after the first changed character to the first
+// statement end that falls in the unchanged tail of the source and was a
+// statement end before. From there on the lexer would see the same text
+// from the same starting point, so the old statements still hold.
+void Incremental::update(std::string_view source)
+{
+	size_t old_size = m_source.size();
+	size_t first = 0;
+	size_t unchanged_from = source.size();
+
+	if (m_valid) {
+		size_t common = std::min(old_size, source.size());
+		size_t prefix = std::mismatch(source.begin(), source.begin() + common, m_source.begin()).first - source.begin();
+		size_t suffix = 0;
+
+		if (prefix == common && old_size == source.size())
+			return;
+
+		while (suffix < common - prefix && source[source.size() - 1 - suffix] == m_source[old_size - 1 - suffix])
+			suffix++;
+
+		// A statement that ends right before the change is kept: it ends
+		// in ';' or '}', which nothing after it can extend
+		first = std::upper_bound(m_statements.begin(), m_statements.end(), prefix,
+			[](size_t offset, const Statement& statement) { return offset < statement.end; }) - m_statements.begin();
+		unchanged_from = source.size() - suffix;
+	} else {
+		m_statements.clear();
+		m_interner.clear();
+		m_names.reset();
+	}
+
+	auto delta = static_cast<ptrdiff_t>(source.size()) - static_cast<ptrdiff_t>(old_size);
+	size_t begin = first == 0 ? 0 : m_statements[first - 1].end;
+	size_t kept = m_statements.size();
+	std::vector<Statement> parsed;
+
+	Lexer lexer(source.substr(begin), m_interner);
+	Parser parser(lexer, m_parsed);
+	flat::Index start = 0;
+
+	while (auto stmt = parser.parse_statement()) {
+		Statement& statement = parsed.emplace_back(Statement{ .end = begin + parser.consumed_end(), .ast = stmt });
+
+		// Every identifier it names, declared or used. Its nodes are the
+		// ones added since the statement before it.
+		for (flat::Index node = start; node <= stmt.value(); node++) {
+			if (m_parsed.kind(node) == flat::Kind::var)
+				statement.symbols.push_back(m_parsed.lhs(node));
+			else if (m_parsed.kind(node) == flat::Kind::let)
+				statement.symbols.push_back(m_parsed.rhs(node));
+		}
+
+		start = stmt.value() + 1;
+		std::sort(statement.symbols.begin(), statement.symbols.end());
+		statement.symbols.erase(std::unique(statement.symbols.begin(), statement.symbols.end()), statement.symbols.end());
+
+		if (!m_valid || statement.end < unchanged_from)
+			continue;
+
+		size_t old_end = statement.end - delta;
+		auto resync = std::lower_bound(m_statements.begin() + first, m_statements.end(), old_end,
+			[](const Statement& old, size_t offset) { return old.end < offset; });
+
+		if (resync != m_statements.end() && resync->end == old_end) {
+			kept = resync - m_statements.begin() + 1;
+			break;
+		}
+	}
+
+	for (size_t i = kept; i < m_statements.size(); i++)
+		m_statements[i].end += delta;
+
+	m_statements.erase(m_statements.begin() + first, m_statements.begin() + kept);
+	m_statements.insert(m_statements.begin() + first, std::make_move_iterator(parsed.begin()), std::make_move_iterator(parsed.end()));
+
+	m_source.assign(source);
+}
+
+// Walks the statements in order with what the ones before them left
+// behind, rebuilding those that were parsed again or whose context
+// changed, then splices the code together. Statements after one that
+// always exits are dropped as the optimizer would, once their names are
+// checked.
+void Incremental::link()
+{
+	m_bindings.assign(m_interner.size(), {});
+
+	size_t stack_size = 0;
+	size_t begin = 0;
+	std::optional<x86::Instr> carried;
+	bool ended = false;
+	bool exited = false;
+
+	for (Statement& statement : m_statements) {
+		size_t statement_begin = begin;
+		begin = statement.end;
+
+		m_uses.clear();
+
+		for (Symbol symbol : statement.symbols) {
+			const Binding& binding = m_bindings[symbol];
+
+			m_uses.push_back({
+				.symbol = symbol,
+				.bound = binding.bound,
+				.distance = binding.bound ? stack_size - binding.stack_pos : 0,
+				.value = binding.value,
+			});
+		}
+
+		if (ended) {
+			if (statement.ast || statement.built || !statement.checked || statement.uses != m_uses)
+				check_statement(statement, statement_begin);
+		} else if (statement.ast || !statement.built || statement.uses != m_uses || statement.carried_in != carried) {
+			build_statement(statement, statement_begin, stack_size, carried);
+			m_rebuilt++;
+		}
+
+		if (statement.declares.has_value()) {
+			m_bindings[statement.declares.value()] = { .bound = true, .stack_pos = stack_size, .value = statement.value };
+			stack_size++;
+		}
+
+		if (!ended) {
+			carried = statement.carried_out;
+			ended = statement.ends_program;
+			exited = exited || statement.exits;
+		}
+	}
+
+	flat::Ast empty;
+	Assembler assembler(empty);
+
+	m_encoder.reset();
+
+	if (m_options.opt_level >= 1) {
+		Peephole peephole(m_encoder);
+
+		if (carried.has_value())
+			peephole.resume(carried.value());
+
+		assembler.assemble_end(peephole, exited);
+	} else {
+		assembler.assemble_end(m_encoder, exited);
+	}
+
+	m_image.clear();
+
+	for (const Statement& statement : m_statements)
+		m_image.insert(m_image.end(), statement.code.begin(), statement.code.end());
+
+	m_image.insert(m_image.end(), m_encoder.bytes().begin(), m_encoder.bytes().end());
+}
+
+// Runs one statement through the rest of the pipeline on its own, with
+// the variables it names bound as m_uses describes
+void Incremental::build_statement(Statement& statement, size_t begin, size_t stack_size, const std::optional<x86::Instr>& carried)
+{
+	flat::Index stmt = parsed(statement, begin);
+	statement.built = false;
+	statement.checked = false;
+
+	// Read before the optimizer moves the node and the Resolver replaces
+	// the symbol with a slot
+	std::optional<Symbol> declares;
+
+	if (m_part.kind(stmt) == flat::Kind::let)
+		declares = m_part.rhs(stmt);
+
+	check();
+
+	Optimizer optimizer(m_part, m_options.opt_level);
+
+	for (const Use& use : m_uses) {
+		if (use.value.has_value())
+			optimizer.bind_const(use.symbol, use.value.value());
+	}
+
+	statement.ends_program = optimizer.optimize();
+	statement.code.clear();
+	statement.carried_out = carried;
+	statement.declares.reset();
+	statement.value.reset();
+	statement.exits = false;
+
+	// Not removed by the optimizer
+	if (!m_part.statements(m_part.root()).empty()) {
+		m_slots.clear();
+
+		for (const Use& use : m_uses) {
+			if (use.bound) {
+				m_resolver.bind(use.symbol);
+				m_slots.push_back(stack_size - use.distance);
+			}
+		}
+
+		m_resolver.resolve(m_part);
+
+		if (declares.has_value()) {
+			statement.declares = declares;
+			statement.value = optimizer.constant(declares.value());
+		}
+
+		Assembler assembler(m_part);
+		Assembler::Frame frame{ .stack_size = stack_size, .slots = m_slots };
+
+		m_encoder.reset();
+
+		if (m_options.opt_level >= 1) {
+			Peephole peephole(m_encoder);
+
+			if (carried.has_value())
+				peephole.resume(carried.value());
+
+			assembler.assemble_part(peephole, frame);
+			statement.carried_out = peephole.pending();
+		} else {
+			assembler.assemble_part(m_encoder, frame);
+		}
+
+		m_encoder.finish();
+		statement.code.assign(m_encoder.bytes().begin(), m_encoder.bytes().end());
+		statement.exits = assembler.exits();
+	}
+
+	statement.built = true;
+	statement.ast.reset();
+	statement.uses = m_uses;
+	statement.carried_in = carried;
+}
+
+// Checks the names of a statement the optimizer drops, so the errors are
+// the same as when it is built
+void Incremental::check_statement(Statement& statement, size_t begin)
+{
+	flat::Index stmt = parsed(statement, begin);
+
+	check();
+
+	statement.built = false;
+	statement.checked = true;
+	statement.ast.reset();
+	statement.uses = m_uses;
+	statement.code.clear();
+	statement.declares.reset();
+	statement.value.reset();
+
+	if (m_part.kind(stmt) == flat::Kind::let)
+		statement.declares = m_part.rhs(stmt);
+}
+
+// Puts the statement in m_part as the only one of its root scope. Kept
+// from an earlier build, the optimizer may have rewritten it, so it is
+// parsed again from its own text.
+flat::Index Incremental::parsed(Statement& statement, size_t begin)
+{
+	m_part.clear();
+	flat::Index stmt = 0;
+
+	if (statement.ast.has_value()) {
+		stmt = m_part.add_copy(m_parsed, statement.ast.value());
+	} else {
+		Lexer lexer(std::string_view(m_source).substr(begin, statement.end - begin), m_interner);
+		Parser parser(lexer, m_part);
+
+		stmt = parser.parse_statement().value();
+	}
+
+	m_part.set_root(m_part.add_scope({ &stmt, 1 }));
+	return stmt;
+}
+
+// Reports the name errors of m_part with the variables in m_uses bound
+void Incremental::check()
+{
+	for (const Use& use : m_uses) {
+		if (use.bound)
+			m_resolver.bind(use.symbol);
+	}
+
+	m_resolver.check(m_part);
+}
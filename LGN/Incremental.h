@@ -0,0 +1,118 @@
+#pragma once
+#include "ArenaAllocator.h"
+#include "Compiler.h"
+#include "Encoder.h"
+#include "FlatAst.h"
+#include "Interner.h"
+#include "Resolver.h"
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace lgn
+{
+	// Rebuilds one input over and over, redoing only what an edit changed.
+	// Every top-level statement keeps its machine code together with what
+	// it was built against: the stack distance and constant value of each
+	// variable it names, and the instruction the peephole pass carried
+	// into it. After an edit only the statements the edit touched are
+	// lexed and parsed again, from the start of the first to the first
+	// statement boundary after the edit that lines up with an old one. A
+	// one-pass walk over the statements then rebuilds the ones whose
+	// context no longer matches, from their own text, and splices the
+	// code. Jumps never leave the statement they are in, so each
+	// statement's code is position independent and numbers its own labels.
+	//
+	// Produces the same executable as Compiler::compile_code(). Errors are
+	// thrown as CompileError; the statements built so far are kept, so the
+	// build that fixes the error is incremental too.
+	class Incremental
+	{
+	public:
+		explicit Incremental(const Options& options);
+
+		// Machine code for source, an executable
+		std::span<const uint8_t> build(std::string_view source);
+
+		inline size_t statement_count() const { return m_statements.size(); }
+
+		// Statements built again by the last build()
+		inline size_t rebuilt() const { return m_rebuilt; }
+
+	private:
+		// A variable a statement names, as seen from before the statement
+		struct Use {
+			Symbol symbol;
+			bool bound = false;
+			// Stack slots between the top of the stack and the variable
+			size_t distance = 0;
+			std::optional<uint64_t> value {};
+
+			bool operator==(const Use& other) const = default;
+		};
+
+		struct Statement {
+			// Offset just past its last token, it begins where the one
+			// before it ends
+			size_t end;
+			// Parsed during this build, not built yet, a node of m_parsed
+			std::optional<flat::Index> ast {};
+			// Every identifier in it, sorted
+			std::vector<Symbol> symbols {};
+
+			// What it was built against, empty until it is built
+			bool built = false;
+			// Dropped after an exit, only its names were checked against uses
+			bool checked = false;
+			std::vector<Use> uses {};
+			std::optional<x86::Instr> carried_in {};
+
+			std::vector<uint8_t> code {};
+			std::optional<x86::Instr> carried_out {};
+			// A top-level let, and its value when it is constant
+			std::optional<Symbol> declares {};
+			std::optional<uint64_t> value {};
+			// The optimizer drops everything after it
+			bool ends_program = false;
+			// Exits at the top level, no fallback exit is needed
+			bool exits = false;
+		};
+
+		// A variable declared by a top-level let
+		struct Binding {
+			bool bound = false;
+			size_t stack_pos = 0;
+			std::optional<uint64_t> value {};
+		};
+
+		const Options& m_options;
+
+		std::string m_source {};
+		std::vector<Statement> m_statements {};
+		bool m_valid = false;
+		size_t m_rebuilt = 0;
+
+		// Kept across builds so the symbols of kept statements stay valid,
+		// with their own copy of the names since the source changes
+		memory::ArenaAllocator m_names {};
+		Interner m_interner;
+		Resolver m_resolver;
+		// The statements parsed by this build, and the one being built
+		flat::Ast m_parsed {};
+		flat::Ast m_part {};
+		x86::Encoder m_encoder {};
+
+		std::vector<Binding> m_bindings {};
+		std::vector<Use> m_uses {};
+		std::vector<size_t> m_slots {};
+		std::vector<uint8_t> m_image {};
+
+		void update(std::string_view source);
+		void link();
+		void build_statement(Statement& statement, size_t begin, size_t stack_size, const std::optional<x86::Instr>& carried);
+		void check_statement(Statement& statement, size_t begin);
+		flat::Index parsed(Statement& statement, size_t begin);
+		void check();
+	};
+}
@@ -0,0 +1,145 @@
+#include "Instr.h"
+using namespace lgn;
+using namespace lgn::x86;
+
+namespace
+{
+	constexpr std::string_view reg_names[] = {
+		"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+		"r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+	};
+
+	constexpr std::string_view reg_names32[] = {
+		"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+		"r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"
+	};
+
+	constexpr std::string_view op_names[] = {
+		"", "push", "pop", "mov", "add", "sub", "imul", "div", "xor", "test", "jz", "jmp", "syscall", "ret"
+	};
+
+	// Collects text with the OutputBuffer interface
+	struct StringOut {
+		std::string& text;
+
+		void write(std::string_view part) { text += part; }
+		void write(char c) { text += c; }
+		void write_uint(uint64_t value)
+		{
+			char digits[20];
+			auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+			text.append(digits, end - digits);
+		}
+	};
+
+	template <typename Out>
+	void write_operand(Out& out, const Operand& operand, bool narrow)
+	{
+		switch (operand.kind) {
+		case Operand::Kind::reg:
+			out.write(narrow ? reg_name32(operand.reg) : reg_name(operand.reg));
+			break;
+		case Operand::Kind::imm:
+			out.write_uint(operand.value);
+			break;
+		case Operand::Kind::mem:
+			out.write("qword [");
+			out.write(reg_name(operand.reg));
+			out.write(" + ");
+			out.write_uint(operand.value);
+			out.write(']');
+			break;
+		case Operand::Kind::label:
+			out.write("label_");
+			out.write_uint(operand.value);
+			break;
+		case Operand::Kind::none:
+			break;
+		}
+	}
+
+	template <typename Out>
+	void write_text(Out& out, const Instr& instr)
+	{
+		if (instr.op == Op::label) {
+			out.write('\n');
+			write_operand(out, instr.dst, false);
+			out.write(":\n");
+			return;
+		}
+
+		// xor only ever clears a register, the 32-bit form does that with a
+		// shorter encoding since writes to a 32-bit register zero the top half
+		bool narrow = instr.op == Op::xor_;
+
+		out.write("    ");
+		out.write(op_names[static_cast<size_t>(instr.op)]);
+
+		if (instr.dst.kind != Operand::Kind::none) {
+			out.write(' ');
+			write_operand(out, instr.dst, narrow);
+		}
+
+		if (instr.src.kind != Operand::Kind::none) {
+			out.write(", ");
+			write_operand(out, instr.src, narrow);
+		}
+
+		out.write('\n');
+	}
+}
+
+std::string_view x86::reg_name(Reg reg)
+{
+	return reg_names[static_cast<size_t>(reg)];
+}
+
+std::string_view x86::reg_name32(Reg reg)
+{
+	return reg_names32[static_cast<size_t>(reg)];
+}
+
+void x86::write_instr(OutputBuffer& out, const Instr& instr)
+{
+	write_text(out, instr);
+}
+
+void x86::write_instr(std::string& text, const Instr& instr)
+{
+	StringOut out{ text };
+	write_text(out, instr);
+}
+
+std::string x86::to_string(const Instr& instr)
+{
+	std::string text;
+	StringOut out{ text };
+	write_text(out, instr);
+
+	// Drop the indentation and the line break
+	size_t begin = text.find_first_not_of(" \n");
+	size_t end = text.find_last_not_of('\n');
+
+	return begin == std::string::npos ? std::string() : text.substr(begin, end + 1 - begin);
+}
+
+void AsmWriter::start()
+{
+	m_out.write("global _start\n_start:\n");
+	m_started = true;
+}
+
+void AsmWriter::write(std::span<const Instr> code)
+{
+	if (!m_started)
+		start();
+
+	for (const Instr& instr : code)
+		write_instr(m_out, instr);
+}
+
+void AsmWriter::finish()
+{
+	if (!m_started)
+		start();
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "OutputBuffer.h"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lgn::x86
+{
+	// Numbered in hardware encoding order
+	enum class Reg : uint8_t {
+		rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+		r8, r9, r10, r11, r12, r13, r14, r15
+	};
+
+	enum class Op : uint8_t {
+		label,		// dst: label
+		push,		// dst: reg, imm or mem
+		pop,		// dst: reg
+		mov,		// dst: reg, src: reg, imm or mem
+		add,		// dst: reg, src: reg or imm
+		sub,
+		imul,		// dst: reg, src: reg
+		div,		// dst: reg (divides rdx:rax)
+		xor_,		// dst: reg, src: reg, printed with 32-bit names
+		test,		// dst: reg, src: reg
+		jz,			// dst: label
+		jmp,		// dst: label
+		syscall,
+		ret
+	};
+
+	struct Operand {
+		enum class Kind : uint8_t {
+			none,
+			reg,
+			imm,
+			mem,	// qword [reg + value]
+			label
+		};
+
+		Kind kind = Kind::none;
+		Reg reg = Reg::rax;
+		uint64_t value = 0;
+
+		static inline Operand make_reg(Reg reg) { return { .kind = Kind::reg, .reg = reg }; }
+		static inline Operand imm(uint64_t value) { return { .kind = Kind::imm, .value = value }; }
+		static inline Operand mem(Reg base, uint64_t disp) { return { .kind = Kind::mem, .reg = base, .value = disp }; }
+		static inline Operand label(uint64_t id) { return { .kind = Kind::label, .value = id }; }
+
+		inline bool is_reg() const { return kind == Kind::reg; }
+		inline bool is_reg(Reg other) const { return kind == Kind::reg && reg == other; }
+		inline bool is_imm() const { return kind == Kind::imm; }
+		inline bool is_imm(uint64_t other) const { return kind == Kind::imm && value == other; }
+
+		bool operator==(const Operand& other) const = default;
+	};
+
+	struct Instr {
+		Op op;
+		Operand dst {};
+		Operand src {};
+
+		bool operator==(const Instr& other) const = default;
+	};
+
+	// Receives emitted code in program order, one chunk at a time, so a
+	// whole program never has to be held as instructions or text.
+	class InstrSink
+	{
+	public:
+		virtual ~InstrSink() = default;
+
+		virtual void write(std::span<const Instr> code) = 0;
+
+		// Called once after the last chunk
+		virtual void finish() {}
+	};
+
+	// Streams the program out as nasm source
+	class AsmWriter : public InstrSink
+	{
+	public:
+		AsmWriter(OutputBuffer& out) : m_out(out) {}
+
+		void write(std::span<const Instr> code) override;
+		void finish() override;
+
+	private:
+		OutputBuffer& m_out;
+		bool m_started = false;
+
+		void start();
+	};
+
+	std::string_view reg_name(Reg reg);
+	std::string_view reg_name32(Reg reg);
+
+	void write_instr(OutputBuffer& out, const Instr& instr);
+
+	// The same appended to text
+	void write_instr(std::string& text, const Instr& instr);
+
+	// Single line of nasm text, for messages
+	std::string to_string(const Instr& instr);
+}
@@ -0,0 +1,57 @@
+#include "Interner.h"
+#include "Hash.h"
+#include <algorithm>
+using namespace lgn;
+
+Symbol Interner::intern(std::string_view text)
+{
+	// At most half full, so probes stay short and always find a free slot
+	if (m_strings.size() * 2 >= m_slots.size())
+		grow();
+
+	uint32_t hash = static_cast<uint32_t>(hash64(text));
+	size_t mask = m_slots.size() - 1;
+
+	for (size_t i = hash & mask;; i = (i + 1) & mask) {
+		Symbol slot = m_slots[i];
+
+		if (slot == 0) {
+			if (m_storage) {
+				auto copy = static_cast<char*>(m_storage->alloc_bytes(text.size(), 1));
+				std::copy(text.begin(), text.end(), copy);
+				text = { copy, text.size() };
+			}
+
+			m_slots[i] = static_cast<Symbol>(m_strings.size() + 1);
+			m_strings.push_back(text);
+			m_hashes.push_back(hash);
+
+			return static_cast<Symbol>(m_strings.size() - 1);
+		}
+
+		if (m_hashes[slot - 1] == hash && m_strings[slot - 1] == text)
+			return slot - 1;
+	}
+}
+
+void Interner::grow()
+{
+	m_slots.assign(std::max<size_t>(m_slots.size() * 2, 64), 0);
+	size_t mask = m_slots.size() - 1;
+
+	for (Symbol symbol = 0; symbol < m_strings.size(); symbol++) {
+		size_t i = m_hashes[symbol] & mask;
+
+		while (m_slots[i] != 0)
+			i = (i + 1) & mask;
+
+		m_slots[i] = symbol + 1;
+	}
+}
+
+void Interner::clear()
+{
+	std::fill(m_slots.begin(), m_slots.end(), 0);
+	m_strings.clear();
+	m_hashes.clear();
+}
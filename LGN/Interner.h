@@ -0,0 +1,42 @@
+#pragma once
+#include "ArenaAllocator.h"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace lgn
+{
+	using Symbol = uint32_t;
+
+	// Maps identifier text to dense ids so later passes compare and index
+	// by integer. Without storage the interned views are not copied, the
+	// text has to outlive the interner (it normally points into the
+	// SourceFile). The table is open addressed, so interning allocates
+	// only when it grows.
+	class Interner
+	{
+	public:
+		Interner() = default;
+
+		// Copies the text of new symbols into storage, for text that
+		// changes while the symbols are still in use
+		explicit Interner(memory::ArenaAllocator* storage) : m_storage(storage) {}
+
+		Symbol intern(std::string_view text);
+
+		inline std::string_view str(Symbol symbol) const { return m_strings[symbol]; }
+		inline size_t size() const { return m_strings.size(); }
+
+		// Forgets every symbol, keeping the allocated tables
+		void clear();
+
+	private:
+		// Symbol + 1 per slot, 0 when empty, probed linearly
+		std::vector<Symbol> m_slots {};
+		std::vector<std::string_view> m_strings {};
+		std::vector<uint32_t> m_hashes {};
+		memory::ArenaAllocator* m_storage = nullptr;
+
+		void grow();
+	};
+}
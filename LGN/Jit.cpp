@@ -0,0 +1,40 @@
+#include "Jit.h"
+#include <cstring>
+#include <sys/mman.h>
+using namespace lgn;
+
+jit::Function::Function(std::span<const uint8_t> code)
+{
+	size_t size = code.empty() ? 1 : code.size();
+	void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (memory == MAP_FAILED)
+		return;
+
+	memcpy(memory, code.data(), code.size());
+
+	// Never writable and executable at the same time
+	if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+		munmap(memory, size);
+		return;
+	}
+
+	m_memory = memory;
+	m_size = size;
+}
+
+jit::Function::~Function()
+{
+	if (m_memory)
+		munmap(m_memory, m_size);
+}
+
+int jit::run(std::span<const uint8_t> code)
+{
+	Function function(code);
+
+	if (!function.is_open())
+		return -1;
+
+	return static_cast<int>(function() & 0xFF);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace lgn::jit
+{
+	// Machine code built for Assembler::Target::function, copied into its
+	// own executable pages so it can be called any number of times.
+	class Function
+	{
+	public:
+		explicit Function(std::span<const uint8_t> code);
+
+		Function(const Function& other) = delete;
+		Function& operator=(const Function& other) = delete;
+
+		~Function();
+
+		inline bool is_open() const { return m_memory != nullptr; }
+
+		// The full 64-bit value the program exits with
+		inline uint64_t operator()() const { return reinterpret_cast<uint64_t (*)()>(m_memory)(); }
+
+	private:
+		void* m_memory = nullptr;
+		size_t m_size = 0;
+	};
+
+	// Calls the code once and returns the exit code it produced, truncated
+	// to 8 bits like a process exit status. Returns -1 when the pages
+	// cannot be mapped.
+	int run(std::span<const uint8_t> code);
+}
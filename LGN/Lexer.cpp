@@ -1,6 +1,150 @@
 #include "Lexer.h"
+#include "Scan.h"
+#include "Error.h"
+#include <array>
+#include <charconv>
+#include <cstdint>
 using namespace lgn;
 
+namespace
+{
+    enum CharClass : uint8_t {
+        cls_invalid,
+        cls_space,
+        cls_alpha,
+        cls_digit,
+        cls_punct,
+        cls_comment
+    };
+
+    constexpr std::array<uint8_t, 256> make_char_classes()
+    {
+        std::array<uint8_t, 256> table {};
+
+        for (int c = 'a'; c <= 'z'; c++)
+            table[c] = cls_alpha;
+
+        for (int c = 'A'; c <= 'Z'; c++)
+            table[c] = cls_alpha;
+
+        for (int c = '0'; c <= '9'; c++)
+            table[c] = cls_digit;
+
+        for (char c : { ' ', '\t', '\n', '\v', '\f', '\r' })
+            table[static_cast<uint8_t>(c)] = cls_space;
+
+        for (char c : { '(', ')', '{', '}', ';', '=', '+', '-', '*', '/' })
+            table[static_cast<uint8_t>(c)] = cls_punct;
+
+        table['#'] = cls_comment;
+
+        return table;
+    }
+
+    constexpr std::array<TokenType, 256> make_punct_types()
+    {
+        std::array<TokenType, 256> table {};
+
+        table['('] = TokenType::tok_lparen;
+        table[')'] = TokenType::tok_rparen;
+        table['{'] = TokenType::tok_lbrace;
+        table['}'] = TokenType::tok_rbrace;
+        table[';'] = TokenType::tok_semi;
+        table['='] = TokenType::tok_eq;
+        table['+'] = TokenType::tok_plus;
+        table['-'] = TokenType::tok_min;
+        table['*'] = TokenType::tok_mul;
+        table['/'] = TokenType::tok_div;
+
+        return table;
+    }
+
+    constexpr auto char_classes = make_char_classes();
+    constexpr auto punct_types = make_punct_types();
+
+    // Keywords are found through a perfect hash over (first char, last char,
+    // length) whose seed is searched at compile time, so an identifier costs
+    // one hash and at most one comparison no matter how many keywords exist.
+    struct Keyword {
+        std::string_view text;
+        TokenType type;
+    };
+
+    constexpr Keyword keywords[] = {
+        { "exit", TokenType::tok_exit },
+        { "let", TokenType::tok_let },
+        { "if", TokenType::tok_if },
+    };
+
+    constexpr size_t keyword_slots = 8;
+    constexpr size_t keyword_max_len = 4;
+
+    constexpr size_t keyword_hash(std::string_view text, uint32_t seed)
+    {
+        return (static_cast<uint8_t>(text.front()) * seed + static_cast<uint8_t>(text.back()) + text.size()) & (keyword_slots - 1);
+    }
+
+    constexpr bool keyword_seed_is_perfect(uint32_t seed)
+    {
+        std::array<bool, keyword_slots> used {};
+
+        for (const Keyword& keyword : keywords) {
+            size_t slot = keyword_hash(keyword.text, seed);
+
+            if (used[slot])
+                return false;
+
+            used[slot] = true;
+        }
+
+        return true;
+    }
+
+    constexpr uint32_t find_keyword_seed()
+    {
+        for (uint32_t seed = 1; seed < 4096; seed++) {
+            if (keyword_seed_is_perfect(seed))
+                return seed;
+        }
+
+        return 0;
+    }
+
+    constexpr uint32_t keyword_seed = find_keyword_seed();
+    static_assert(keyword_seed != 0, "no perfect hash seed for the keyword set");
+
+    constexpr std::array<int8_t, keyword_slots> make_keyword_table()
+    {
+        std::array<int8_t, keyword_slots> table {};
+
+        for (int8_t& slot : table)
+            slot = -1;
+
+        for (size_t i = 0; i < std::size(keywords); i++) {
+            if (keywords[i].text.size() > keyword_max_len)
+                throw "keyword_max_len is too small";
+
+            table[keyword_hash(keywords[i].text, keyword_seed)] = static_cast<int8_t>(i);
+        }
+
+        return table;
+    }
+
+    constexpr auto keyword_table = make_keyword_table();
+
+    inline TokenType classify_word(std::string_view word)
+    {
+        if (word.size() <= keyword_max_len) {
+            int8_t idx = keyword_table[keyword_hash(word, keyword_seed)];
+
+            if (idx >= 0 && keywords[idx].text == word)
+                return keywords[idx].type;
+        }
+
+        return TokenType::tok_id;
+    }
+}
+
 std::optional<int> bin_prec(TokenType type)
 {
     switch (type)
@@ -16,98 +160,120 @@ std::optional<int> bin_prec(TokenType type)
     }
 }
 
-std::vector<Token> Lexer::tokenize()
+Lexer::Lexer(std::string_view src, Interner& interner)
+    : Lexer(src, interner, scan::kernels())
 {
-    std::vector<Token> tokens;
-    std::string buf;
+}
 
-    while (peek().has_value()) {
-        if (std::isalpha(peek().value())) {
-            buf.push_back(consume());
+Lexer::Lexer(std::string_view src, Interner& interner, const scan::Kernels& kernels)
+    : m_begin(src.data()), m_pos(src.data()), m_end(src.data() + src.size()), m_scan(kernels), m_interner(interner)
+{
+    // Tokens keep 32-bit offsets
+    if (src.size() > UINT32_MAX)
+        throw CompileError("Source files are limited to 4 GiB");
+}
 
-            while (peek().has_value() && std::isalnum(peek().value())) {
-                buf.push_back(consume());
-            }
+Token Lexer::make_token(TokenType type, const char* start, const char* end)
+{
+    if (end - start > UINT16_MAX)
+        throw CompileError("Tokens are limited to 65535 characters");
 
-            if (buf == "exit") {
-                tokens.push_back({ .type = TokenType::tok_kw, .value = "exit" });
-                buf.clear();
-            } else if (buf == "let") {
-                tokens.push_back({ .type = TokenType::tok_kw, .value = "let" });
-                buf.clear();
-            } else if (buf == "if") {
-                tokens.push_back({ .type = TokenType::tok_kw, .value = "if"});
-                buf.clear();
-            } else {
-                tokens.push_back({ .type = TokenType::tok_id, .value = buf });
-                buf.clear();
-            }
+    return {
+        .type = type,
+        .length = static_cast<uint16_t>(end - start),
+        .offset = static_cast<uint32_t>(start - m_begin),
+        .value = 0,
+    };
+}
 
-        } else if (std::isdigit(peek().value())) {
-            buf.push_back(consume());
+bool Lexer::next(Token& token)
+{
+    const char* p = m_pos;
 
-            while (peek().has_value() && std::isdigit(peek().value())) {
-                buf.push_back(consume());
+    while (p < m_end) {
+        switch (char_classes[static_cast<uint8_t>(*p)]) {
+        case cls_space:
+            p = m_scan.skip_space(p + 1, m_end);
+            break;
+        case cls_alpha:
+        {
+            const char* start = p;
+            p = m_scan.skip_ident(p + 1, m_end);
+
+            std::string_view word(start, p - start);
+            token = make_token(classify_word(word), start, p);
+
+            if (token.type == TokenType::tok_id)
+                token.symbol = m_interner.intern(word);
+
+            m_pos = p;
+            m_count++;
+            return true;
+        }
+        case cls_digit:
+        {
+            const char* start = p;
+            p = m_scan.skip_digits(p + 1, m_end);
+
+            token = make_token(TokenType::tok_int, start, p);
+
+            if (std::from_chars(start, p, token.value).ec != std::errc()) {
+                token.overflow = true;
+                token.symbol = m_interner.intern(std::string_view(start, p - start));
             }
 
-            tokens.push_back({ .type = TokenType::tok_int, .value = buf });
-            buf.clear();
-        } else if (peek().value() == '(') {
-            consume();
-            tokens.push_back({ .type = TokenType::tok_lparen });
-        } else if (peek().value() == ')') {
-            consume();
-            tokens.push_back({ .type = TokenType::tok_rparen });
-        } else if (peek().value() == '{') {
-            consume();
-            tokens.push_back({ .type = TokenType::tok_lbrace });
-        } else if (peek().value() == '}') {
-            consume();
-            tokens.push_back({ .type = TokenType::tok_rbrace });
-        } else if (peek().value() == ';') {
-            consume();
-            tokens.push_back({ .type = TokenType::tok_semi });
-        } else if (std::isspace(peek().value())) {
-            consume();
-        } else if (peek().value() == '=') {
-            consume();
-            tokens.push_back({ .type = TokenType::tok_eq });
-        } else if (peek().value() == '+') {
-            consume();
-            tokens.push_back({ .type = TokenType::tok_plus });
-        } else if (peek().value() == '-') {
-            consume();
-            tokens.push_back({ .type = TokenType::tok_min });
-        } else if (peek().value() == '*') {
-            consume();
-            tokens.push_back({ .type = TokenType::tok_mul });
-        } else if (peek().value() == '/') {
-            consume();
-            tokens.push_back({ .type = TokenType::tok_div });
-        } else if (peek().value() == '#') {
-            consume();
-
-            while (peek().value() != '\n')
-                consume();
-        } else {
-            std::cerr << "Invalid character: " << peek().value() << std::endl;
-            exit(EXIT_SUCCESS);
+            m_pos = p;
+            m_count++;
+            return true;
+        }
+        case cls_punct:
+            token = make_token(punct_types[static_cast<uint8_t>(*p)], p, p + 1);
+            m_pos = p + 1;
+            m_count++;
+            return true;
+        case cls_comment:
+            p = m_scan.find_newline(p + 1, m_end);
+            break;
+        default:
+            m_pos = p;
+            throw CompileError(std::string("Invalid character: ") + *p);
         }
     }
 
-    m_idx = 0;
-    return tokens;
+    m_pos = p;
+    return false;
 }
 
-std::optional<char> Lexer::peek(int count) const
+size_t Lexer::read(Token* out, size_t capacity)
 {
-    if (m_idx + count >= m_src.length())
-        return {};
+    size_t count = 0;
 
-    return m_src.at(m_idx + count);
+    while (count < capacity && next(out[count]))
+        count++;
+
+    return count;
 }
 
-char Lexer::consume()
+std::vector<Token> Lexer::tokenize()
 {
-    return m_src.at(m_idx++);
+    std::vector<Token> tokens;
+    tokens.reserve((m_end - m_pos) / 8);
+
+    Token token;
+
+    while (next(token))
+        tokens.push_back(token);
+
+    return tokens;
+}
+
+size_t Lexer::tokenize(TokenRing& ring)
+{
+    size_t start = m_count;
+    Token token;
+
+    while (next(token))
+        ring.push(token);
+
+    return m_count - start;
 }
@@ -1,22 +1,51 @@
 #pragma once
 #include "Token.h"
+#include "TokenRing.h"
+#include "Scan.h"
+#include "Interner.h"
 #include <iostream>
+#include <optional>
 #include <vector>
 
 std::optional<int> bin_prec(TokenType type);
 
 namespace lgn
 {
-	class Lexer {
+	// Lexes on demand: each call to next() or read() scans just far enough
+	// for the tokens it returns. The parser reads it directly, so no more
+	// than its lookahead window of tokens ever exists at once and a mapped
+	// source is paged in as parsing reaches it.
+	class Lexer : public TokenSource {
 	public:
-		Lexer(const std::string& src) : m_src(src) {}
+		// Identifiers are interned into interner as they are lexed
+		Lexer(std::string_view src, Interner& interner);
 
+		// Scans runs with kernels instead of the ones scan::kernels() picks
+		Lexer(std::string_view src, Interner& interner, const scan::Kernels& kernels);
+
+		// The next token, false at the end of the input
+		bool next(Token& token);
+
+		size_t read(Token* out, size_t capacity) override;
+
+		// Every remaining token
 		std::vector<Token> tokenize();
+
+		// Pushes the remaining tokens into ring as they are found, for a
+		// parser on another thread. Returns how many there were; does not
+		// close the ring.
+		size_t tokenize(TokenRing& ring);
+
+		// Tokens returned so far
+		inline size_t count() const { return m_count; }
 	private:
-		const std::string m_src;
-		size_t m_idx = 0;
+		const char* m_begin;
+		const char* m_pos;
+		const char* m_end;
+		const scan::Kernels& m_scan;
+		Interner& m_interner;
+		size_t m_count = 0;
 
-		std::optional<char> peek(int count = 0) const;
-		char consume();
+		inline Token make_token(TokenType type, const char* start, const char* end);
 	};
 }
@@ -0,0 +1,238 @@
+#include "Optimizer.h"
+using namespace lgn;
+
+bool Optimizer::optimize()
+{
+	if (m_level <= 0)
+		return false;
+
+	bool exits = optimize_statements(m_ast.root());
+
+	// Folded expressions and removed statements leave nodes behind
+	m_ast.compact();
+	return exits;
+}
+
+std::optional<uint64_t> Optimizer::constant(Symbol name) const
+{
+	auto iterator = m_consts.find(name);
+
+	if (iterator == m_consts.end())
+		return {};
+
+	return iterator->second;
+}
+
+// Compacts the list in place and reports whether it always ends in an exit,
+// in which case everything after that point has already been dropped.
+bool Optimizer::optimize_statements(flat::Index scope)
+{
+	std::span<flat::Index> statements = m_ast.statements(scope);
+	flat::Index out = 0;
+
+	for (size_t i = 0; i < statements.size(); i++) {
+		Flow flow = optimize_statement(statements[i]);
+
+		if (flow == Flow::removed)
+			continue;
+
+		statements[out++] = statements[i];
+
+		if (flow == Flow::exits) {
+			m_ast.set_operand(scope, m_ast.lhs(scope), out);
+			return true;
+		}
+	}
+
+	m_ast.set_operand(scope, m_ast.lhs(scope), out);
+	return false;
+}
+
+Optimizer::Flow Optimizer::optimize_statement(flat::Index stmt)
+{
+	switch (m_ast.kind(stmt)) {
+	case flat::Kind::exit:
+		fold_expr(m_ast.lhs(stmt));
+		return Flow::exits;
+	case flat::Kind::let:
+	{
+		std::optional<uint64_t> value = fold_expr(m_ast.lhs(stmt));
+		Symbol name = m_ast.rhs(stmt);
+
+		if (value.has_value() && m_level >= 2) {
+			m_consts[name] = value.value();
+			m_bound.push_back(name);
+		}
+
+		return Flow::falls_through;
+	}
+	case flat::Kind::if_:
+	{
+		std::optional<uint64_t> cond = fold_expr(m_ast.lhs(stmt));
+		flat::Index scope = m_ast.rhs(stmt);
+
+		if (!cond.has_value()) {
+			optimize_scope(scope);
+			return Flow::falls_through;
+		}
+
+		if (cond.value() == 0)
+			return Flow::removed;
+
+		// Always taken, the body becomes a plain scope
+		m_ast.set_node(stmt, flat::Kind::scope, m_ast.lhs(scope), m_ast.rhs(scope));
+		return optimize_scope(stmt);
+	}
+	case flat::Kind::scope:
+		return optimize_scope(stmt);
+	default:
+		return Flow::falls_through;
+	}
+}
+
+Optimizer::Flow Optimizer::optimize_scope(flat::Index scope)
+{
+	m_scopes.push_back(m_bound.size());
+
+	bool exits = optimize_statements(scope);
+
+	for (size_t i = m_scopes.back(); i < m_bound.size(); i++)
+		m_consts.erase(m_bound[i]);
+
+	m_bound.resize(m_scopes.back());
+	m_scopes.pop_back();
+
+	return exits ? Flow::exits : Flow::falls_through;
+}
+
+// Folds the expression in place and returns its value when it is constant
+std::optional<uint64_t> Optimizer::fold_expr(flat::Index expr)
+{
+	switch (m_ast.kind(expr)) {
+	case flat::Kind::int_lit:
+		return int_value(expr);
+	case flat::Kind::var:
+	{
+		auto iterator = m_consts.find(m_ast.lhs(expr));
+
+		if (iterator == m_consts.end())
+			return {};
+
+		replace_with_int(expr, iterator->second);
+		return iterator->second;
+	}
+	default:
+		return fold_binary(expr);
+	}
+}
+
+std::optional<uint64_t> Optimizer::fold_binary(flat::Index expr)
+{
+	flat::Kind kind = m_ast.kind(expr);
+	flat::Index left = m_ast.lhs(expr);
+	flat::Index right = m_ast.rhs(expr);
+
+	std::optional<uint64_t> lhs = fold_expr(left);
+	std::optional<uint64_t> rhs = fold_expr(right);
+
+	if (lhs.has_value() && rhs.has_value()) {
+		uint64_t value = 0;
+
+		switch (kind) {
+		case flat::Kind::add:
+			value = lhs.value() + rhs.value();
+			break;
+		case flat::Kind::sub:
+			value = lhs.value() - rhs.value();
+			break;
+		case flat::Kind::mul:
+			value = lhs.value() * rhs.value();
+			break;
+		default:
+			// Division by zero keeps faulting at runtime
+			if (rhs.value() == 0)
+				return {};
+
+			value = lhs.value() / rhs.value();
+			break;
+		}
+
+		replace_with_int(expr, value);
+		return value;
+	}
+
+	std::optional<flat::Index> keep;
+
+	switch (kind) {
+	case flat::Kind::add:
+		if (lhs == 0u)
+			keep = right;
+		else if (rhs == 0u)
+			keep = left;
+		break;
+	case flat::Kind::sub:
+		if (rhs == 0u)
+			keep = left;
+		break;
+	case flat::Kind::mul:
+		if (lhs == 1u) {
+			keep = right;
+		} else if (rhs == 1u) {
+			keep = left;
+		} else if ((lhs == 0u && !may_trap(right)) || (rhs == 0u && !may_trap(left))) {
+			replace_with_int(expr, 0);
+			return 0;
+		}
+		break;
+	default:
+		if (rhs == 1u)
+			keep = left;
+		break;
+	}
+
+	// The node takes the kept operand's place, which compact() then drops
+	if (keep.has_value())
+		m_ast.set_node(expr, m_ast.kind(*keep), m_ast.lhs(*keep), m_ast.rhs(*keep));
+
+	return {};
+}
+
+std::optional<uint64_t> Optimizer::int_value(flat::Index expr) const
+{
+	if (m_ast.kind(expr) != flat::Kind::int_lit)
+		return {};
+
+	// Resolver::check() rejects literals that do not fit in 64 bits
+	// before the optimizer runs, this only keeps them from being folded
+	if (m_ast.rhs(expr) != 0)
+		return {};
+
+	return m_ast.literal(expr);
+}
+
+// Whether evaluating the expression can fault, i.e. it divides by
+// something that is not a non-zero literal.
+bool Optimizer::may_trap(flat::Index expr) const
+{
+	switch (m_ast.kind(expr)) {
+	case flat::Kind::int_lit:
+	case flat::Kind::var:
+		return false;
+	case flat::Kind::div:
+	{
+		std::optional<uint64_t> divisor = int_value(m_ast.rhs(expr));
+
+		if (!divisor.has_value() || divisor.value() == 0)
+			return true;
+
+		return may_trap(m_ast.lhs(expr));
+	}
+	default:
+		return may_trap(m_ast.lhs(expr)) || may_trap(m_ast.rhs(expr));
+	}
+}
+
+void Optimizer::replace_with_int(flat::Index expr, uint64_t value)
+{
+	m_ast.set_node(expr, flat::Kind::int_lit, m_ast.add_value(value), 0);
+}
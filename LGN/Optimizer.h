@@ -0,0 +1,58 @@
+#pragma once
+#include "FlatAst.h"
+#include "Interner.h"
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace lgn
+{
+	// Tree-level optimizations run between Parser::parse and code generation,
+	// rewriting the nodes of the Ast in place and compacting it afterwards.
+	//   -O1 folds constant subexpressions, simplifies x+0, x-0, x*1, x/1 and
+	//       x*0, removes if statements whose condition is constant and drops
+	//       statements that follow an unconditional exit.
+	//   -O2 also propagates let bindings whose value is a constant.
+	class Optimizer
+	{
+	public:
+		Optimizer(flat::Ast& ast, int level) : m_ast(ast), m_level(level) {}
+
+		// True when the program always ends in an exit
+		bool optimize();
+
+		// For optimizing a program one top-level statement at a time: the
+		// constant bindings of the statements before it, and what a let in
+		// it turned out to be bound to.
+		inline void bind_const(Symbol name, uint64_t value) { m_consts[name] = value; }
+		std::optional<uint64_t> constant(Symbol name) const;
+
+	private:
+		enum class Flow {
+			falls_through,
+			exits,
+			removed
+		};
+
+		flat::Ast& m_ast;
+		int m_level;
+
+		// Constant let bindings currently in scope, the names are unique
+		// among the live variables so a flat map is enough.
+		std::unordered_map<Symbol, uint64_t> m_consts {};
+		std::vector<Symbol> m_bound {};
+		std::vector<size_t> m_scopes {};
+
+		bool optimize_statements(flat::Index scope);
+		Flow optimize_statement(flat::Index stmt);
+		Flow optimize_scope(flat::Index scope);
+
+		std::optional<uint64_t> fold_expr(flat::Index expr);
+		std::optional<uint64_t> fold_binary(flat::Index expr);
+
+		std::optional<uint64_t> int_value(flat::Index expr) const;
+		bool may_trap(flat::Index expr) const;
+		void replace_with_int(flat::Index expr, uint64_t value);
+	};
+}
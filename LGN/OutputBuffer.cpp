@@ -0,0 +1,89 @@
+#include "OutputBuffer.h"
+#include <cerrno>
+#include <sys/uio.h>
+#include <unistd.h>
+using namespace lgn;
+
+namespace
+{
+	// writev may stop early, keep going until every part is out
+	bool write_all(int fd, iovec* parts, int count)
+	{
+		while (count > 0) {
+			ssize_t written = writev(fd, parts, count);
+
+			if (written < 0) {
+				if (errno == EINTR)
+					continue;
+
+				return false;
+			}
+
+			while (count > 0 && static_cast<size_t>(written) >= parts->iov_len) {
+				written -= parts->iov_len;
+				parts++;
+				count--;
+			}
+
+			if (count > 0) {
+				parts->iov_base = static_cast<char*>(parts->iov_base) + written;
+				parts->iov_len -= written;
+			}
+		}
+
+		return true;
+	}
+}
+
+OutputBuffer::OutputBuffer(int fd, size_t capacity)
+	: m_fd(fd), m_data(new char[capacity]), m_capacity(capacity)
+{
+}
+
+OutputBuffer::~OutputBuffer()
+{
+	flush();
+}
+
+bool OutputBuffer::flush()
+{
+	if (m_size > 0) {
+		iovec part = { .iov_base = m_data.get(), .iov_len = m_size };
+
+		if (m_fd < 0 || !write_all(m_fd, &part, 1))
+			m_ok = false;
+
+		m_size = 0;
+	}
+
+	return m_ok;
+}
+
+void OutputBuffer::reset(int fd)
+{
+	flush();
+
+	m_fd = fd;
+	m_ok = true;
+}
+
+void OutputBuffer::write_slow(std::string_view text)
+{
+	// Small pieces just start a new buffer, large ones skip the copy
+	if (text.size() < m_capacity / 2) {
+		flush();
+		memcpy(m_data.get(), text.data(), text.size());
+		m_size = text.size();
+		return;
+	}
+
+	iovec parts[] = {
+		{ .iov_base = m_data.get(), .iov_len = m_size },
+		{ .iov_base = const_cast<char*>(text.data()), .iov_len = text.size() },
+	};
+
+	if (m_fd < 0 || !write_all(m_fd, parts, 2))
+		m_ok = false;
+
+	m_size = 0;
+}
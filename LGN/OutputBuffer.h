@@ -0,0 +1,68 @@
+#pragma once
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+
+namespace lgn
+{
+	// Fixed-size write buffer in front of a file descriptor. Text is copied
+	// in until the buffer is full and then written out, a chunk larger than
+	// the free space goes out together with the buffered bytes in a single
+	// writev. Memory use is the capacity, however much is written.
+	class OutputBuffer
+	{
+	public:
+		static constexpr size_t default_capacity = 64 * 1024;
+
+		explicit OutputBuffer(int fd, size_t capacity = default_capacity);
+
+		OutputBuffer(const OutputBuffer& other) = delete;
+		OutputBuffer& operator=(const OutputBuffer& other) = delete;
+
+		~OutputBuffer();
+
+		inline void write(std::string_view text)
+		{
+			if (text.size() <= m_capacity - m_size) {
+				memcpy(m_data.get() + m_size, text.data(), text.size());
+				m_size += text.size();
+			} else {
+				write_slow(text);
+			}
+		}
+
+		inline void write(char c)
+		{
+			if (m_size == m_capacity)
+				flush();
+
+			m_data[m_size++] = c;
+		}
+
+		inline void write_uint(uint64_t value)
+		{
+			char digits[20];
+			auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+			write(std::string_view(digits, end - digits));
+		}
+
+		// Writes out everything buffered so far
+		bool flush();
+
+		// Starts writing to another descriptor, keeping the buffer
+		void reset(int fd);
+
+		inline bool ok() const { return m_ok; }
+
+	private:
+		int m_fd;
+		std::unique_ptr<char[]> m_data;
+		size_t m_capacity;
+		size_t m_size = 0;
+		bool m_ok = true;
+
+		void write_slow(std::string_view text);
+	};
+}
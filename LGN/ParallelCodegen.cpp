@@ -0,0 +1,234 @@
+#include "ParallelCodegen.h"
+#include "Encoder.h"
+#include "Peephole.h"
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+using namespace lgn;
+
+namespace
+{
+	// Below this a range costs more to set up and join than it saves
+	constexpr size_t min_range_size = 256;
+
+	// Ranges per thread, so threads that finish early can steal the rest
+	constexpr size_t ranges_per_thread = 4;
+
+	// Machine code of a range of statements
+	class CodeBuffer
+	{
+	public:
+		inline void reset(uint64_t label_base) { m_encoder.reset(label_base); }
+		inline x86::InstrSink& sink() { return m_encoder; }
+		inline size_t size() const { return m_encoder.bytes().size(); }
+
+		std::string_view view(size_t begin, size_t end) const
+		{
+			return { reinterpret_cast<const char*>(m_encoder.bytes().data()) + begin, end - begin };
+		}
+
+	private:
+		x86::Encoder m_encoder;
+	};
+
+	// nasm source of a range of statements
+	class TextBuffer : public x86::InstrSink
+	{
+	public:
+		void write(std::span<const x86::Instr> code) override
+		{
+			for (const x86::Instr& instr : code)
+				x86::write_instr(m_text, instr);
+		}
+
+		inline void reset(uint64_t) { m_text.clear(); }
+		inline x86::InstrSink& sink() { return *this; }
+		inline size_t size() const { return m_text.size(); }
+		inline std::string_view view(size_t begin, size_t end) const { return std::string_view(m_text).substr(begin, end - begin); }
+
+	private:
+		std::string m_text;
+	};
+
+	// Where the code of a statement ends in its range's buffer, with the
+	// peephole's state and counters at that point
+	struct Mark {
+		size_t end;
+		std::optional<x86::Instr> pending;
+		size_t removed;
+		size_t rewritten;
+	};
+
+	template <typename Buffer>
+	struct Range {
+		size_t begin;
+		size_t end;
+		Buffer buffer {};
+		std::vector<Mark> marks {};
+		std::exception_ptr error {};
+	};
+}
+
+void ParallelCodegen::generate(std::vector<uint8_t>& code)
+{
+	code.clear();
+
+	run<CodeBuffer>([&](std::string_view part) { code.insert(code.end(), part.begin(), part.end()); });
+}
+
+void ParallelCodegen::generate(OutputBuffer& out)
+{
+	out.write("global _start\n_start:\n");
+
+	run<TextBuffer>([&](std::string_view part) { out.write(part); });
+}
+
+template <typename Buffer, typename Append>
+void ParallelCodegen::run(Append append)
+{
+	std::vector<Assembler::Start> starts;
+	std::vector<size_t> slots;
+	bool exited = Assembler(m_ast, m_target).plan(starts, slots);
+
+	size_t count = starts.size();
+	size_t range_count = std::min(std::max<size_t>(1, count / min_range_size), m_pool.thread_count() * ranges_per_thread);
+
+	// The optimizer may have removed every statement
+	if (count == 0)
+		range_count = 0;
+
+	std::vector<Range<Buffer>> ranges;
+
+	for (size_t i = 0; i < range_count; i++)
+		ranges.push_back({ .begin = count * i / range_count, .end = count * (i + 1) / range_count });
+
+	// One Assembler per thread, each numbers the nodes of the whole Ast
+	std::vector<std::unique_ptr<Assembler>> assemblers(m_pool.thread_count());
+
+	auto assembler_of = [&](size_t worker) -> Assembler& {
+		if (!assemblers[worker]) {
+			assemblers[worker] = std::make_unique<Assembler>(m_ast, m_target);
+			assemblers[worker]->prepare(slots);
+		}
+
+		return *assemblers[worker];
+	};
+
+	m_pool.run(ranges.size(), [&](size_t index, size_t worker) {
+		Range<Buffer>& range = ranges[index];
+
+		try {
+			Assembler& assembler = assembler_of(worker);
+			std::optional<Peephole> peephole;
+
+			if (m_peephole)
+				peephole.emplace(range.buffer.sink());
+
+			x86::InstrSink& sink = peephole ? peephole.value() : range.buffer.sink();
+
+			range.buffer.reset(starts[range.begin].label_base);
+			range.marks.reserve(range.end - range.begin);
+
+			for (size_t stmt = range.begin; stmt < range.end; stmt++) {
+				assembler.assemble_at(sink, stmt, starts[stmt]);
+
+				range.marks.push_back({
+					.end = range.buffer.size(),
+					.pending = peephole ? peephole->pending() : std::nullopt,
+					.removed = peephole ? peephole->removed() : 0,
+					.rewritten = peephole ? peephole->rewritten() : 0,
+				});
+			}
+
+			// What the peephole holds back is left to the next range
+			range.buffer.sink().finish();
+		} catch (...) {
+			range.error = std::current_exception();
+		}
+	});
+
+	for (const Range<Buffer>& range : ranges) {
+		if (range.error)
+			std::rethrow_exception(range.error);
+	}
+
+	m_emitted = 0;
+	m_removed = 0;
+	m_rewritten = 0;
+
+	for (const std::unique_ptr<Assembler>& assembler : assemblers) {
+		if (assembler)
+			m_emitted += assembler->emitted();
+	}
+
+	// Joins the ranges, doing the start of those that follow a held back
+	// instruction again. Counters are unsigned, a statement that forwards
+	// the instruction carried into it may well remove a negative count.
+	Assembler& assembler = assembler_of(0);
+	std::optional<x86::Instr> carried;
+	Buffer buffer;
+
+	for (const Range<Buffer>& range : ranges) {
+		size_t resumed = range.begin;
+
+		if (carried.has_value()) {
+			Peephole peephole(buffer.sink());
+
+			buffer.reset(starts[range.begin].label_base);
+			peephole.resume(carried.value());
+
+			// Until the peephole is where it was in the first run
+			do {
+				assembler.assemble_at(peephole, resumed, starts[resumed]);
+				carried = peephole.pending();
+				resumed++;
+			} while (resumed < range.end && carried != range.marks[resumed - range.begin - 1].pending);
+
+			buffer.sink().finish();
+			append(buffer.view(0, buffer.size()));
+			m_removed += peephole.removed();
+			m_rewritten += peephole.rewritten();
+		}
+
+		if (resumed == range.end)
+			continue;
+
+		const Mark& last = range.marks.back();
+		const Mark* first = resumed == range.begin ? nullptr : &range.marks[resumed - range.begin - 1];
+
+		append(range.buffer.view(first ? first->end : 0, last.end));
+		m_removed += last.removed - (first ? first->removed : 0);
+		m_rewritten += last.rewritten - (first ? first->rewritten : 0);
+		carried = last.pending;
+	}
+
+	Buffer end;
+	size_t emitted = assembler.emitted();
+	end.reset(0);
+
+	// Without statements the entry code goes with the end
+	auto assemble_end = [&](x86::InstrSink& sink) {
+		if (count == 0)
+			assembler.assemble(sink);
+		else
+			assembler.assemble_end(sink, exited);
+	};
+
+	if (m_peephole) {
+		Peephole peephole(end.sink());
+
+		if (carried.has_value())
+			peephole.resume(carried.value());
+
+		assemble_end(peephole);
+		m_removed += peephole.removed();
+		m_rewritten += peephole.rewritten();
+	} else {
+		assemble_end(end.sink());
+	}
+
+	append(end.view(0, end.size()));
+	m_emitted += assembler.emitted() - emitted;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "Assembler.h"
+#include "FlatAst.h"
+#include "OutputBuffer.h"
+#include "ThreadPool.h"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace lgn
+{
+	// Generates the code of the top-level statements on every thread of a
+	// pool. Assembler::plan() gives each statement the stack depth,
+	// variables and first label it starts with, so ranges of statements
+	// are assembled, optimized and encoded into buffers of their own,
+	// which are then joined in order. The one thing a range cannot know is
+	// the instruction the peephole pass holds back at the end of the range
+	// before it, which may combine with its first instructions. Ranges
+	// start with nothing held back, and the join assembles the first
+	// statements of a range again with the instruction actually carried
+	// in, until the peephole holds back what it did the first time. From
+	// there on the range is what a single thread produces, so the output
+	// is the same byte for byte.
+	class ParallelCodegen
+	{
+	public:
+		// peephole: optimize the code as generate() in Compiler does
+		ParallelCodegen(const flat::Ast& ast, Assembler::Target target, bool peephole, ThreadPool& pool)
+			: m_ast(ast), m_target(target), m_peephole(peephole), m_pool(pool) {}
+
+		// Machine code, as an Encoder behind Assembler::assemble() has it
+		void generate(std::vector<uint8_t>& code);
+
+		// nasm source, as an AsmWriter writes it
+		void generate(OutputBuffer& out);
+
+		// The counters of the Assembler and the Peephole of a single thread
+		inline size_t emitted() const { return m_emitted; }
+		inline size_t removed() const { return m_removed; }
+		inline size_t rewritten() const { return m_rewritten; }
+
+	private:
+		const flat::Ast& m_ast;
+		Assembler::Target m_target;
+		bool m_peephole;
+		ThreadPool& m_pool;
+
+		size_t m_emitted = 0;
+		size_t m_removed = 0;
+		size_t m_rewritten = 0;
+
+		// Runs the whole program through Buffers, passing their contents
+		// to append in order
+		template <typename Buffer, typename Append>
+		void run(Append append);
+	};
+}
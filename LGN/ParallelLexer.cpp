@@ -0,0 +1,97 @@
+#include "ParallelLexer.h"
+#include "Lexer.h"
+#include "Error.h"
+#include <algorithm>
+#include <cstring>
+using namespace lgn;
+
+namespace
+{
+	// Below this a chunk costs more to set up and merge than it saves
+	constexpr size_t min_chunk_size = 64 << 10;
+
+	// Chunks per thread, so threads that finish early can steal the rest
+	constexpr size_t chunks_per_thread = 4;
+}
+
+ParallelLexer::ParallelLexer(std::string_view src, Interner& interner, ThreadPool& pool)
+	: m_src(src), m_interner(interner), m_pool(pool)
+{
+	// Tokens keep 32-bit offsets
+	if (src.size() > UINT32_MAX)
+		throw CompileError("Source files are limited to 4 GiB");
+}
+
+void ParallelLexer::tokenize()
+{
+	size_t target = std::max(min_chunk_size, m_src.size() / (m_pool.thread_count() * chunks_per_thread));
+
+	for (size_t begin = 0; begin < m_src.size();) {
+		size_t end = m_src.size();
+
+		if (m_src.size() - begin > target) {
+			auto newline = static_cast<const char*>(memchr(m_src.data() + begin + target, '\n', m_src.size() - begin - target));
+			end = newline ? newline - m_src.data() + 1 : m_src.size();
+		}
+
+		m_chunks.push_back({ .text = m_src.substr(begin, end - begin), .offset = static_cast<uint32_t>(begin) });
+		begin = end;
+	}
+
+	m_pool.run(m_chunks.size(), [&](size_t index, size_t) {
+		Chunk& chunk = m_chunks[index];
+
+		try {
+			Lexer lexer(chunk.text, chunk.interner);
+			chunk.tokens = lexer.tokenize();
+		} catch (...) {
+			chunk.error = std::current_exception();
+		}
+	});
+
+	for (const Chunk& chunk : m_chunks) {
+		if (chunk.error)
+			std::rethrow_exception(chunk.error);
+	}
+
+	for (Chunk& chunk : m_chunks) {
+		chunk.symbols.resize(chunk.interner.size());
+
+		for (Symbol symbol = 0; symbol < chunk.interner.size(); symbol++)
+			chunk.symbols[symbol] = m_interner.intern(chunk.interner.str(symbol));
+
+		m_count += chunk.tokens.size();
+	}
+
+	m_pool.run(m_chunks.size(), [&](size_t index, size_t) {
+		Chunk& chunk = m_chunks[index];
+
+		for (Token& token : chunk.tokens) {
+			token.offset += chunk.offset;
+
+			if (token.type == TokenType::tok_id || token.overflow)
+				token.symbol = chunk.symbols[token.symbol];
+		}
+	});
+}
+
+size_t ParallelLexer::read(Token* out, size_t capacity)
+{
+	size_t count = 0;
+
+	while (count < capacity && m_chunk < m_chunks.size()) {
+		const std::vector<Token>& tokens = m_chunks[m_chunk].tokens;
+		size_t available = std::min(capacity - count, tokens.size() - m_index);
+
+		std::copy_n(tokens.data() + m_index, available, out + count);
+		count += available;
+		m_index += available;
+
+		if (m_index == tokens.size()) {
+			m_chunk++;
+			m_index = 0;
+		}
+	}
+
+	return count;
+}
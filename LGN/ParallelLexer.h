@@ -0,0 +1,56 @@
+#pragma once
+#include "Interner.h"
+#include "ThreadPool.h"
+#include "Token.h"
+#include "TokenSource.h"
+#include <exception>
+#include <string_view>
+#include <vector>
+
+namespace lgn
+{
+	// Lexes a large source on every thread of a pool. The source is cut
+	// into chunks right after newlines: no token spans a newline and a '#'
+	// comment ends at one, so each chunk starts exactly where the
+	// sequential lexer is between tokens and outside any comment, and no
+	// chunk needs repairing. Each chunk is lexed with an interner of its
+	// own, then the chunks' symbols are interned in source order, which
+	// gives them the ids the sequential lexer would have, and the tokens
+	// are renumbered and rebased in place. The parser reads the chunks'
+	// token arrays one after the other, they are never concatenated.
+	class ParallelLexer : public TokenSource {
+	public:
+		// Identifiers are interned into interner
+		ParallelLexer(std::string_view src, Interner& interner, ThreadPool& pool);
+
+		// Lexes the whole source. Throws the error the sequential lexer
+		// would have run into first.
+		void tokenize();
+
+		size_t read(Token* out, size_t capacity) override;
+
+		inline size_t count() const { return m_count; }
+
+	private:
+		struct Chunk {
+			std::string_view text;
+			uint32_t offset;
+			Interner interner {};
+			std::vector<Token> tokens {};
+			// Symbol in the shared interner of every symbol of the chunk's
+			std::vector<Symbol> symbols {};
+			std::exception_ptr error {};
+		};
+
+		std::string_view m_src;
+		Interner& m_interner;
+		ThreadPool& m_pool;
+
+		std::vector<Chunk> m_chunks {};
+		size_t m_count = 0;
+
+		// Read position
+		size_t m_chunk = 0;
+		size_t m_index = 0;
+	};
+}
@@ -1,71 +1,67 @@
 #include "Parser.h"
 #include "Lexer.h"
+#include "Error.h"
 using namespace lgn;
 
-std::optional<node::Program> Parser::parse()
+void Parser::parse()
 {
-	node::Program prog;
+	size_t mark = m_open.size();
 
-	while (peek().has_value()) {
-		if (auto stmt = parse_stmt()) {
-			prog.statements.push_back(stmt.value());
-		}
-	}
+	while (auto stmt = parse_statement())
+		m_open.push_back(stmt.value());
 
-	return prog;
+	m_ast.set_root(m_ast.add_scope({ m_open.begin() + mark, m_open.end() }));
+	m_open.resize(mark);
 }
 
-std::optional<node::Term*> lgn::Parser::parse_term()
+std::optional<flat::Index> Parser::parse_statement()
 {
-	if (auto tok_int = try_consume(TokenType::tok_int)) {
-		auto term_int = m_allocator.alloc<node::TermInt>();
-		term_int->tok_int = tok_int.value();
+	if (!peek().has_value())
+		return {};
 
-		auto term = m_allocator.alloc<node::Term>();
-		term->term = term_int;
+	auto stmt = parse_stmt();
 
-		return term;
-	} else if (auto tok_id = try_consume(TokenType::tok_id)) {
-		auto term_id = m_allocator.alloc<node::TermId>();
-		term_id->tok_id = tok_id.value();
+	// Nothing was consumed, looping again would never end
+	if (!stmt.has_value())
+		throw CompileError("Expected statement");
+
+	return stmt;
+}
 
-		auto term = m_allocator.alloc<node::Term>();
-		term->term = term_id;
+std::optional<flat::Index> lgn::Parser::parse_term()
+{
+	if (auto tok_int = try_consume(TokenType::tok_int)) {
+		// The text of a literal that does not fit is kept for the error
+		// Resolver::check() reports
+		if (tok_int->overflow)
+			return m_ast.add_node(flat::Kind::int_lit, 0, tok_int->symbol + 1);
 
-		return term;
+		return m_ast.add_node(flat::Kind::int_lit, m_ast.add_value(tok_int->value));
+	} else if (auto tok_id = try_consume(TokenType::tok_id)) {
+		return m_ast.add_node(flat::Kind::var, tok_id->symbol);
 	} else if (auto tok_paren = try_consume(TokenType::tok_lparen)) {
 		auto expr = parse_expr();
 
 		if (!expr.has_value()) {
-			std::cerr << "Expected expression" << std::endl;
-			exit(EXIT_SUCCESS);
+			throw CompileError("Expected expression");
 		}
 
 		try_consume(TokenType::tok_rparen, "Expected ')'");
 
-		auto term_paren = m_allocator.alloc<node::TermParen>();
-		term_paren->expr = expr.value();
-
-		auto term = m_allocator.alloc<node::Term>();
-		term->term = term_paren;
-
-		return term;
+		return expr;
 	}
 
 	return {};
 }
 
-std::optional<node::Expr*> Parser::parse_expr(int min_prec)
+std::optional<flat::Index> Parser::parse_expr(int min_prec)
 {
-	std::optional<node::Term*> term_left = parse_term();
+	std::optional<flat::Index> expr_left = parse_term();
 
-	if (!term_left.has_value()) {
+	if (!expr_left.has_value()) {
 		return {};
 	}
 
-	auto expr_left = m_allocator.alloc<node::Expr>();
-	expr_left->expr = term_left.value();
-
 	while (true) {
 		std::optional<Token> curr_tok = peek();
 		std::optional<int> prec;
@@ -85,206 +81,150 @@ std::optional<node::Expr*> Parser::parse_expr(int min_prec)
 		auto expr_right = parse_expr(next_min_prec);
 
 		if (!expr_right.has_value()) {
-			std::cerr << "Unable to parse expression" << std::endl;
-			exit(EXIT_SUCCESS);
+			throw CompileError("Unable to parse expression");
 		}
 
-		auto expr = m_allocator.alloc<node::BinExpr>();
-		auto expr_lhs = m_allocator.alloc<node::Expr>();
-
-		if (op.type == TokenType::tok_plus) {
-			auto add = m_allocator.alloc<node::BinExprAdd>();
-
-			expr_lhs->expr = expr_left->expr;
-
-			add->left = expr_lhs;
-			add->right = expr_right.value();
-			
-			expr->expr = add;
-		} else if (op.type == TokenType::tok_min) {
-			auto sub = m_allocator.alloc<node::BinExprSub>();
+		flat::Kind kind = flat::Kind::add;
 
-			expr_lhs->expr = expr_left->expr;
-
-			sub->left = expr_lhs;
-			sub->right = expr_right.value();
-
-			expr->expr = sub;
+		if (op.type == TokenType::tok_min) {
+			kind = flat::Kind::sub;
 		} else if (op.type == TokenType::tok_mul) {
-			auto mul = m_allocator.alloc<node::BinExprMul>();
-
-			expr_lhs->expr = expr_left->expr;
-
-			mul->left = expr_lhs;
-			mul->right = expr_right.value();
-
-			expr->expr = mul;
+			kind = flat::Kind::mul;
 		} else if (op.type == TokenType::tok_div) {
-			auto div = m_allocator.alloc<node::BinExprDiv>();
-
-			expr_lhs->expr = expr_left->expr;
-
-			div->left = expr_lhs;
-			div->right = expr_right.value();
-
-			expr->expr = div;
+			kind = flat::Kind::div;
 		}
 
-		expr_left->expr = expr;
+		expr_left = m_ast.add_node(kind, expr_left.value(), expr_right.value());
 	}
 
 	return expr_left;
 }
 
-std::optional<node::BinExpr*> lgn::Parser::parse_bin_expr()
+std::optional<flat::Index> lgn::Parser::parse_stmt()
 {
-	if (auto left = parse_expr()) {
-		auto bin_expr = m_allocator.alloc<node::BinExpr>();
-		
-		if (peek().has_value() && peek().value().type == TokenType::tok_plus) {
-			auto bin_expr_add = m_allocator.alloc<node::BinExprAdd>();
-			bin_expr_add->left = left.value();
-			consume();
-
-			if (auto right = parse_expr()) {
-				bin_expr_add->right = right.value();
-				bin_expr->expr = bin_expr_add;
-
-				return bin_expr;
-			}
-			
-			std::cerr << "Expected expression after '+'" << std::endl;
-			exit(EXIT_SUCCESS);
+	if (!peek().has_value())
+		return {};
+
+	switch (peek().value().type) {
+	case TokenType::tok_exit:
+	{
+		consume();
+		try_consume(TokenType::tok_lparen, "Expected '('");
+
+		auto expr = parse_expr();
+
+		if (!expr.has_value()) {
+			throw CompileError("Expected expression");
 		}
 
-		std::cerr << "Unsupported binary operator (Implementing soon)" << std::endl;
-		exit(EXIT_SUCCESS);
+		try_consume(TokenType::tok_rparen, "Expected ')'");
+		try_consume(TokenType::tok_semi, "Expected ';' at end-of-line");
+
+		return m_ast.add_node(flat::Kind::exit, expr.value());
 	}
+	case TokenType::tok_let:
+	{
+		consume();
 
-	return {};
-}
+		Token tok_id = try_consume(TokenType::tok_id, "Expected identifier");
 
-std::optional<node::Statement*> lgn::Parser::parse_stmt()
-{
-	if (peek().has_value() && peek().value().type == TokenType::tok_kw) {
-		if (peek().value().value == "exit") {
-			consume();
+		try_consume(TokenType::tok_eq, "Expected identifier after '='");
 
-			auto stmt_exit = m_allocator.alloc<node::StatementExit>();
+		auto expr = parse_expr();
 
-			try_consume(TokenType::tok_lparen, "Expected '('");
+		if (!expr.has_value()) {
+			throw CompileError("Expected expression");
+		}
 
-			if (auto node_expr = parse_expr()) {
-				stmt_exit->expr = node_expr.value();
-			} else {
-				std::cerr << "Expected expression" << std::endl;
-				exit(EXIT_SUCCESS);
-			}
+		try_consume(TokenType::tok_semi, "Expected ';' at end-of-line");
 
-			try_consume(TokenType::tok_rparen, "Expected ')'");
-			try_consume(TokenType::tok_semi, "Expected ';' at end-of-line");
-
-			auto stmt = m_allocator.alloc<node::Statement>();
-			stmt->statement = stmt_exit;
-
-			return stmt;
-		} else if (peek().value().value == "let") {
-			consume();
-
-			auto stmt_let = m_allocator.alloc<node::StatementLet>();
-			stmt_let->tok_id = try_consume(TokenType::tok_id, "Expected identifier");
-
-			try_consume(TokenType::tok_eq, "Expected identifier after '='");
-
-			if (auto node_expr = parse_expr()) {
-				stmt_let->expr = node_expr.value();
-			} else {
-				std::cerr << "Expected expression" << std::endl;
-				exit(EXIT_SUCCESS);
-			}
-
-			try_consume(TokenType::tok_semi, "Expected ';' at end-of-line");
-
-			auto stmt = m_allocator.alloc<node::Statement>();
-			stmt->statement = stmt_let;
-
-			return stmt;
-		} else if (peek().value().value == "if") {
-			consume();
-			bool open_paren = false;
-			auto stmt_if = m_allocator.alloc<node::StatementIf>();
-
-			if (peek().value().type == TokenType::tok_lparen) {
-				consume();
-				open_paren = true;
-			}
-
-			if (auto expr = parse_expr()) {
-				stmt_if->expr = expr.value();
-			} else {
-				std::cerr << "Expected expression" << std::endl;
-				exit(EXIT_SUCCESS);
-			}
-
-			if (open_paren)
-				try_consume(TokenType::tok_rparen, "Expected ')'");
-
-			if (auto scope = parse_scope()) {
-				stmt_if->scope = scope.value();
-			} else {
-				std::cerr << "Expected '{'" << std::endl;
-				exit(EXIT_SUCCESS);
-			}
-
-			auto stmt = m_allocator.alloc<node::Statement>();
-			stmt->statement = stmt_if;
-
-			return stmt;
-		} else {
-			std::cerr << "Unknown keyword '" << peek().value().value.value() << "'" << std::endl;
-			exit(EXIT_SUCCESS);
+		return m_ast.add_node(flat::Kind::let, expr.value(), tok_id.symbol);
+	}
+	case TokenType::tok_if:
+	{
+		consume();
+		bool open_paren = try_consume(TokenType::tok_lparen).has_value();
+
+		auto expr = parse_expr();
+
+		if (!expr.has_value()) {
+			throw CompileError("Expected expression");
 		}
-	} else if (peek().has_value() && peek().value().type == TokenType::tok_lbrace) {
-		if (auto scope = parse_scope()) {
-			auto stmt = m_allocator.alloc<node::Statement>();
-			stmt->statement = scope.value();
 
-			return stmt;
+		if (open_paren)
+			try_consume(TokenType::tok_rparen, "Expected ')'");
+
+		auto scope = parse_scope();
+
+		if (!scope.has_value()) {
+			throw CompileError("Expected '{'");
 		}
 
-		std::cerr << "Expected '{'" << std::endl;
+		return m_ast.add_node(flat::Kind::if_, expr.value(), scope.value());
+	}
+	case TokenType::tok_lbrace:
+		return parse_scope();
+	default:
+		return {};
 	}
-
-	return {};
 }
 
-std::optional<node::Scope*> lgn::Parser::parse_scope()
+std::optional<flat::Index> lgn::Parser::parse_scope()
 {
 	if (!try_consume(TokenType::tok_lbrace))
 		return {};
 
-	auto scope = m_allocator.alloc<node::Scope>();
+	size_t mark = m_open.size();
 
 	while (auto stmt = parse_stmt()) {
-		scope->statements.push_back(stmt.value());
+		m_open.push_back(stmt.value());
 	}
 
 	try_consume(TokenType::tok_rbrace, "Expected '}'");
 
+	flat::Index scope = m_ast.add_scope({ m_open.begin() + mark, m_open.end() });
+	m_open.resize(mark);
+
 	return scope;
 }
 
 std::optional<Token> Parser::peek(int count)
 {
-	if (m_idx + count >= m_tks.size())
+	if (m_idx + count >= m_end && !fill(count + 1))
 		return {};
 
-	return m_tks.at(m_idx + count);
+	return m_window[m_idx + count];
 }
 
 Token Parser::consume()
 {
-	return m_tks.at(m_idx++);
+	if (m_idx >= m_end && !fill(1))
+		throw CompileError("Unexpected end of input");
+
+	const Token& token = m_window[m_idx++];
+	m_consumed_end = token.offset + token.length;
+
+	return token;
+}
+
+// Moves the unconsumed tokens to the front of the window and reads behind
+// them until count are available. False if the input ends first.
+bool Parser::fill(size_t count)
+{
+	std::copy(m_window.begin() + m_idx, m_window.begin() + m_end, m_window.begin());
+	m_end -= m_idx;
+	m_idx = 0;
+
+	while (m_end < count) {
+		size_t read = m_tokens.read(m_window.data() + m_end, m_window.size() - m_end);
+
+		if (read == 0)
+			return false;
+
+		m_end += read;
+	}
+
+	return true;
 }
 
 std::optional<Token> lgn::Parser::try_consume(TokenType type)
@@ -300,6 +240,5 @@ Token lgn::Parser::try_consume(TokenType type, const std::string& err)
 	if (peek().has_value() && peek().value().type == type)
 		return consume();
 
-	std::cerr << err << std::endl;
-	exit(EXIT_SUCCESS);
+	throw CompileError(err);
 }
@@ -1,26 +1,52 @@
 #pragma once
-#include "Node.h"
-#include "ArenaAllocator.h"
+#include "FlatAst.h"
+#include "Token.h"
+#include "TokenSource.h"
+#include <array>
+#include <optional>
 #include <vector>
 #include <iostream>
 
 namespace lgn
 {
+	// Recursive descent straight into a flat::Ast, children are added
+	// before their parents as the grammar returns from them, so no tree of
+	// nodes exists in between.
 	class Parser
 	{
 	public:
-		Parser(const std::vector<Token>& tokens) : m_tks(tokens), m_allocator(1024 * 1024 * 4) {}
-
-		std::optional<node::Program> parse();
-		std::optional<node::Term*> parse_term();
-		std::optional<node::Expr*> parse_expr(int min_prec = 0);
-		std::optional<node::BinExpr*> parse_bin_expr();
-		std::optional<node::Statement*> parse_stmt();
-		std::optional<node::Scope*> parse_scope();
+		Parser(TokenSource& tokens, flat::Ast& ast) : m_tokens(tokens), m_ast(ast) {}
+
+		// Appends every statement of the input and sets the root to a scope
+		// holding the top-level ones
+		void parse();
+
+		// Appends the next top-level statement, nullopt at the end of the
+		// input. Throws on anything else, as parse() does.
+		std::optional<flat::Index> parse_statement();
+
+		// Offset in the source just past the last token consumed
+		inline uint32_t consumed_end() const { return m_consumed_end; }
+
+		std::optional<flat::Index> parse_term();
+		std::optional<flat::Index> parse_expr(int min_prec = 0);
+		std::optional<flat::Index> parse_stmt();
+		std::optional<flat::Index> parse_scope();
 	private:
-		const std::vector<Token> m_tks;
+		TokenSource& m_tokens;
+		flat::Ast& m_ast;
+
+		// Statements of the scopes still open, innermost last
+		std::vector<flat::Index> m_open;
+
+		// The tokens read from the source but not consumed yet are
+		// m_window[m_idx, m_end), the parser never looks further ahead
+		std::array<Token, 64> m_window;
 		size_t m_idx = 0;
-		memory::ArenaAllocator m_allocator;
+		size_t m_end = 0;
+		uint32_t m_consumed_end = 0;
+
+		bool fill(size_t count);
 
 		std::optional<Token> peek(int count = 0);
 		Token consume();
@@ -0,0 +1,134 @@
+#include "Peephole.h"
+using namespace lgn;
+using x86::Instr;
+using x86::Op;
+using x86::Operand;
+using x86::Reg;
+
+namespace
+{
+	// Whether a rule can still change the instruction depending on what
+	// follows it
+	bool may_combine(const Instr& instr)
+	{
+		return instr.op == Op::push
+			|| (instr.op == Op::add && instr.dst.is_reg(Reg::rsp) && instr.src.is_imm())
+			|| (instr.op == Op::mov && instr.dst.is_reg() && instr.src.is_imm(0));
+	}
+}
+
+// The pending output doubles as a stack: every instruction is first
+// matched against the last one kept, so a removed pair exposes the
+// instructions around it to the same rules. The last instruction is held
+// back between chunks when it may still pair with the next chunk.
+void Peephole::write(std::span<const Instr> code)
+{
+	m_received += code.size();
+
+	for (const Instr& instr : code) {
+		if (!combine(instr))
+			m_out.push_back(instr);
+	}
+
+	size_t held = !m_out.empty() && may_combine(m_out.back()) ? 1 : 0;
+
+	if (m_out.size() > held)
+		forward(m_out.size() - held);
+}
+
+std::optional<Instr> Peephole::pending() const
+{
+	if (m_out.empty())
+		return {};
+
+	return m_out.back();
+}
+
+void Peephole::resume(const Instr& instr)
+{
+	m_out.push_back(instr);
+}
+
+void Peephole::finish()
+{
+	forward(m_out.size());
+	m_next.finish();
+}
+
+// Returns true when the instruction was folded into the output
+bool Peephole::combine(const Instr& instr)
+{
+	bool stack_adjust = (instr.op == Op::add || instr.op == Op::sub) && instr.dst.is_reg(Reg::rsp) && instr.src.is_imm();
+
+	if (stack_adjust && instr.src.value == 0)
+		return true;
+
+	if (instr.op == Op::mov && instr.src.is_reg() && instr.dst == instr.src)
+		return true;
+
+	if (m_out.empty())
+		return false;
+
+	Instr& last = m_out.back();
+
+	if (stack_adjust && instr.op == Op::add && last.op == Op::add && last.dst.is_reg(Reg::rsp) && last.src.is_imm()) {
+		last.src.value += instr.src.value;
+		m_rewritten++;
+		return true;
+	}
+
+	// The slot just pushed is still in the register it came from
+	if (instr.op == Op::mov && instr.src == Operand::mem(Reg::rsp, 0) && last.op == Op::push && last.dst.is_reg()) {
+		Instr mov{ .op = Op::mov, .dst = instr.dst, .src = last.dst };
+		m_rewritten++;
+
+		if (!combine(mov))
+			m_out.push_back(mov);
+
+		return true;
+	}
+
+	if (instr.op == Op::pop && last.op == Op::push) {
+		if (last.dst == instr.dst) {
+			m_out.pop_back();
+			return true;
+		}
+
+		// push reads its operand before moving rsp, so a memory operand
+		// relative to rsp still names the same slot in the mov.
+		Instr mov{ .op = Op::mov, .dst = instr.dst, .src = last.dst };
+		m_out.pop_back();
+		m_rewritten++;
+
+		if (!combine(mov))
+			m_out.push_back(mov);
+
+		return true;
+	}
+
+	return false;
+}
+
+// Passes the first count pending instructions on. Zero moves become xor
+// on the way out, which is only safe when the flags are not live: only jz
+// reads them and it always directly follows the test that sets them.
+void Peephole::forward(size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		Instr& instr = m_out[i];
+
+		if (instr.op != Op::mov || !instr.dst.is_reg() || !instr.src.is_imm(0))
+			continue;
+
+		if (i + 1 < m_out.size() && m_out[i + 1].op == Op::jz)
+			continue;
+
+		instr = { .op = Op::xor_, .dst = instr.dst, .src = instr.dst };
+		m_rewritten++;
+	}
+
+	m_next.write(std::span<const Instr>(m_out.data(), count));
+	m_forwarded += count;
+
+	m_out.erase(m_out.begin(), m_out.begin() + count);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "Instr.h"
+#include <optional>
+
+namespace lgn
+{
+	// Local rewrites over the emitted instructions, applied as they stream
+	// from the Assembler to the next sink:
+	//   push X / pop R       -> mov R, X (or nothing when X is R)
+	//   push R / mov S, [rsp] -> push R / mov S, R (or nothing when S is R)
+	//   add rsp, 0           -> removed
+	//   add rsp, a / add rsp, b -> add rsp, a + b
+	//   mov R, R             -> removed
+	//   mov R, 0             -> xor R, R (when the flags are not live)
+	class Peephole : public x86::InstrSink
+	{
+	public:
+		Peephole(x86::InstrSink& next) : m_next(next) {}
+
+		void write(std::span<const x86::Instr> code) override;
+		void finish() override;
+
+		// The instruction held back at the end of the last write, for
+		// carrying the stream on in another Peephole with resume(). Counted
+		// as received by this one and as forwarded by the one that resumes.
+		std::optional<x86::Instr> pending() const;
+		void resume(const x86::Instr& instr);
+
+		inline size_t removed() const { return m_received - m_forwarded; }
+		inline size_t rewritten() const { return m_rewritten; }
+
+	private:
+		x86::InstrSink& m_next;
+		std::vector<x86::Instr> m_out;
+
+		size_t m_received = 0;
+		size_t m_forwarded = 0;
+		size_t m_rewritten = 0;
+
+		bool combine(const x86::Instr& instr);
+		void forward(size_t count);
+	};
+}
@@ -0,0 +1,215 @@
+#include "Profiler.h"
+#include "OutputBuffer.h"
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+using namespace lgn;
+
+namespace
+{
+	uint64_t now(clockid_t clock)
+	{
+		timespec time {};
+		clock_gettime(clock, &time);
+
+		return static_cast<uint64_t>(time.tv_sec) * 1'000'000'000 + time.tv_nsec;
+	}
+
+	void add(Profiler::Counters& total, const Profiler::Counters& counters)
+	{
+		total.tokens += counters.tokens;
+		total.nodes += counters.nodes;
+		total.ast_bytes += counters.ast_bytes;
+		total.instructions += counters.instructions;
+		total.output_bytes += counters.output_bytes;
+	}
+
+	void write_json_string(OutputBuffer& out, std::string_view text)
+	{
+		out.write('"');
+
+		for (char c : text) {
+			if (c == '"' || c == '\\') {
+				out.write('\\');
+				out.write(c);
+			} else if (static_cast<unsigned char>(c) < 0x20) {
+				char escape[8];
+				snprintf(escape, sizeof(escape), "\\u%04x", c);
+				out.write(escape);
+			} else {
+				out.write(c);
+			}
+		}
+
+		out.write('"');
+	}
+
+	// Microseconds with three decimals, as the trace format expects
+	void write_micros(OutputBuffer& out, uint64_t nanos)
+	{
+		char digits[4] = { '.', static_cast<char>('0' + nanos / 100 % 10), static_cast<char>('0' + nanos / 10 % 10), static_cast<char>('0' + nanos % 10) };
+
+		out.write_uint(nanos / 1000);
+		out.write(std::string_view(digits, sizeof(digits)));
+	}
+}
+
+Profiler::Scope::Scope(Profiler* profiler, std::string_view phase, const std::string& input)
+	: m_profiler(profiler), m_phase(phase), m_input(input)
+{
+	if (m_profiler) {
+		m_start_wall = now(CLOCK_MONOTONIC);
+		m_start_cpu = now(CLOCK_THREAD_CPUTIME_ID);
+	}
+}
+
+Profiler::Scope::~Scope()
+{
+	if (!m_profiler)
+		return;
+
+	uint64_t wall = now(CLOCK_MONOTONIC) - m_start_wall;
+	uint64_t cpu = now(CLOCK_THREAD_CPUTIME_ID) - m_start_cpu;
+
+	m_profiler->record({ .phase = m_phase, .input = m_input, .thread = 0, .start = m_start_wall, .wall = wall, .cpu = cpu, .counters = m_counters });
+}
+
+Profiler::Profiler() : m_start(now(CLOCK_MONOTONIC))
+{
+}
+
+void Profiler::record(Event event)
+{
+	std::lock_guard lock(m_mutex);
+
+	// Threads are numbered in the order they first record something
+	std::thread::id id = std::this_thread::get_id();
+	size_t thread = 0;
+
+	while (thread < m_threads.size() && m_threads[thread] != id)
+		thread++;
+
+	if (thread == m_threads.size())
+		m_threads.push_back(id);
+
+	event.thread = thread;
+	m_events.push_back(std::move(event));
+}
+
+void Profiler::report(std::ostream& out) const
+{
+	struct Phase {
+		std::string_view name;
+		uint64_t wall = 0;
+		uint64_t cpu = 0;
+		size_t count = 0;
+	};
+
+	std::lock_guard lock(m_mutex);
+
+	// Phases keep the order they were first seen in, which follows the pipeline
+	std::vector<Phase> phases;
+	Counters total;
+	uint64_t phase_wall = 0;
+
+	for (const Event& event : m_events) {
+		size_t i = 0;
+
+		while (i < phases.size() && phases[i].name != event.phase)
+			i++;
+
+		if (i == phases.size())
+			phases.push_back({ .name = event.phase });
+
+		phases[i].wall += event.wall;
+		phases[i].cpu += event.cpu;
+		phases[i].count++;
+		add(total, event.counters);
+
+		if (event.phase != "compile")
+			phase_wall += event.wall;
+	}
+
+	rusage usage {};
+	getrusage(RUSAGE_SELF, &usage);
+
+	char line[128];
+	auto millis = [](uint64_t nanos) { return static_cast<double>(nanos) / 1e6; };
+
+	out << "phase           count     wall ms      cpu ms    wall %\n";
+
+	for (const Phase& phase : phases) {
+		double share = phase.name == "compile" || phase_wall == 0 ? 100.0 : 100.0 * phase.wall / phase_wall;
+		snprintf(line, sizeof(line), "%-12.*s %8zu %11.3f %11.3f %8.1f%%\n", static_cast<int>(phase.name.size()), phase.name.data(),
+			phase.count, millis(phase.wall), millis(phase.cpu), share);
+		out << line;
+	}
+
+	snprintf(line, sizeof(line), "elapsed %31.3f ms\n", millis(now(CLOCK_MONOTONIC) - m_start));
+	out << line;
+
+	out << "tokens          " << total.tokens << "\n"
+		<< "ast nodes       " << total.nodes << "\n"
+		<< "ast bytes       " << total.ast_bytes << "\n"
+		<< "instructions    " << total.instructions << "\n"
+		<< "output bytes    " << total.output_bytes << "\n"
+		<< "peak rss        " << usage.ru_maxrss << " KiB" << std::endl;
+}
+
+bool Profiler::write_trace(const char* path) const
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0)
+		return false;
+
+	OutputBuffer out(fd);
+	std::lock_guard lock(m_mutex);
+
+	out.write("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	for (size_t i = 0; i < m_events.size(); i++) {
+		const Event& event = m_events[i];
+
+		out.write("{\"name\":");
+		write_json_string(out, event.phase);
+		out.write(",\"cat\":\"lgn\",\"ph\":\"X\",\"pid\":1,\"tid\":");
+		out.write_uint(event.thread);
+		out.write(",\"ts\":");
+		write_micros(out, event.start - m_start);
+		out.write(",\"dur\":");
+		write_micros(out, event.wall);
+		out.write(",\"tdur\":");
+		write_micros(out, event.cpu);
+		out.write(",\"args\":{\"input\":");
+		write_json_string(out, event.input);
+
+		const Counters& counters = event.counters;
+		std::pair<std::string_view, uint64_t> fields[] = {
+			{ "tokens", counters.tokens },
+			{ "nodes", counters.nodes },
+			{ "ast_bytes", counters.ast_bytes },
+			{ "instructions", counters.instructions },
+			{ "output_bytes", counters.output_bytes },
+		};
+
+		for (auto [name, value] : fields) {
+			if (value == 0)
+				continue;
+
+			out.write(",\"");
+			out.write(name);
+			out.write("\":");
+			out.write_uint(value);
+		}
+
+		out.write(i + 1 < m_events.size() ? "}},\n" : "}}\n");
+	}
+
+	out.write("]}\n");
+
+	bool ok = out.flush();
+	return close(fd) == 0 && ok;
+}
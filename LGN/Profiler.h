@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace lgn
+{
+	// Records how long each phase of each compilation takes, in wall and
+	// CPU time, along with a few size counters, for --time-report and
+	// --trace. Any number of threads can record into one profiler.
+	class Profiler
+	{
+	public:
+		struct Counters {
+			uint64_t tokens = 0;
+			uint64_t nodes = 0;
+			uint64_t ast_bytes = 0;
+			uint64_t instructions = 0;
+			uint64_t output_bytes = 0;
+		};
+
+		// Times a phase from construction to destruction. Does nothing
+		// without a profiler, so the calls can stay in place unconditionally.
+		class Scope
+		{
+		public:
+			Scope(Profiler* profiler, std::string_view phase, const std::string& input);
+			~Scope();
+
+			Scope(const Scope& other) = delete;
+			Scope& operator=(const Scope& other) = delete;
+
+			// Reported with the phase, in the trace and in the totals
+			inline Counters& counters() { return m_counters; }
+
+		private:
+			Profiler* m_profiler;
+			std::string_view m_phase;
+			const std::string& m_input;
+			uint64_t m_start_wall;
+			uint64_t m_start_cpu;
+			Counters m_counters {};
+		};
+
+		Profiler();
+
+		// Table of the phases summed over every input, then the counters
+		// and the peak resident set size
+		void report(std::ostream& out) const;
+
+		// Chrome trace event JSON, one complete event per phase per input
+		bool write_trace(const char* path) const;
+
+	private:
+		struct Event {
+			std::string_view phase;
+			std::string input;
+			size_t thread;
+			uint64_t start;
+			uint64_t wall;
+			uint64_t cpu;
+			Counters counters;
+		};
+
+		mutable std::mutex m_mutex;
+		std::vector<Event> m_events;
+		std::vector<std::thread::id> m_threads;
+		uint64_t m_start;
+
+		void record(Event event);
+	};
+}
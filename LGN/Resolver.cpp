@@ -0,0 +1,197 @@
+#include "Resolver.h"
+#include "Error.h"
+using namespace lgn;
+
+void Resolver::resolve(flat::Ast& ast)
+{
+	m_ast = &ast;
+	m_bindings.resize(m_interner.size(), unbound);
+
+	// The top level is not a scope of its own, its variables live until
+	// exit. They are only forgotten afterwards so the next Ast starts clean.
+	try {
+		for (flat::Index stmt : ast.statements(ast.root()))
+			resolve_statement(stmt);
+	} catch (...) {
+		forget();
+		throw;
+	}
+
+	ast.set_slot_count(m_slot_count);
+	forget();
+}
+
+void Resolver::check(const flat::Ast& ast)
+{
+	m_bindings.resize(m_interner.size(), unbound);
+
+	try {
+		for (flat::Index stmt : ast.statements(ast.root()))
+			check_statement(ast, stmt);
+	} catch (...) {
+		forget();
+		throw;
+	}
+
+	forget();
+}
+
+void Resolver::forget()
+{
+	for (Symbol symbol : m_declared)
+		m_bindings[symbol] = unbound;
+
+	m_declared.clear();
+	m_scopes.clear();
+	m_slot_count = 0;
+}
+
+flat::Index Resolver::bind(Symbol symbol)
+{
+	m_bindings.resize(m_interner.size(), unbound);
+	m_bindings[symbol] = m_slot_count;
+	m_declared.push_back(symbol);
+
+	return m_slot_count++;
+}
+
+void Resolver::begin_scope()
+{
+	m_scopes.push_back(m_declared.size());
+}
+
+void Resolver::end_scope()
+{
+	for (size_t i = m_scopes.back(); i < m_declared.size(); i++)
+		m_bindings[m_declared[i]] = unbound;
+
+	m_declared.resize(m_scopes.back());
+	m_scopes.pop_back();
+}
+
+void Resolver::expect_undeclared(Symbol symbol) const
+{
+	if (m_bindings[symbol] != unbound) {
+		throw CompileError("Identifier '" + std::string(m_interner.str(symbol)) + "' is already declared");
+	}
+}
+
+void Resolver::expect_declared(Symbol symbol) const
+{
+	if (m_bindings[symbol] == unbound) {
+		throw CompileError("Undeclared identifier '" + std::string(m_interner.str(symbol)) + "'");
+	}
+}
+
+// The Parser stores 1 + the symbol of the literal's text when it does not fit
+void Resolver::expect_fits(const flat::Ast& ast, flat::Index int_lit) const
+{
+	if (ast.rhs(int_lit) != 0) {
+		throw CompileError("Integer literal '" + std::string(m_interner.str(ast.rhs(int_lit) - 1)) + "' does not fit in 64 bits");
+	}
+}
+
+void Resolver::resolve_statements(flat::Index scope)
+{
+	begin_scope();
+
+	for (flat::Index stmt : m_ast->statements(scope))
+		resolve_statement(stmt);
+
+	end_scope();
+}
+
+void Resolver::resolve_statement(flat::Index stmt)
+{
+	switch (m_ast->kind(stmt)) {
+	case flat::Kind::exit:
+		resolve_expr(m_ast->lhs(stmt));
+		break;
+	case flat::Kind::let:
+	{
+		Symbol symbol = m_ast->rhs(stmt);
+		expect_undeclared(symbol);
+
+		// The value cannot refer to the variable it initializes
+		resolve_expr(m_ast->lhs(stmt));
+
+		flat::Index slot = m_slot_count++;
+		m_bindings[symbol] = slot;
+		m_declared.push_back(symbol);
+		m_ast->set_operand(stmt, m_ast->lhs(stmt), slot);
+		break;
+	}
+	case flat::Kind::if_:
+		resolve_expr(m_ast->lhs(stmt));
+		resolve_statements(m_ast->rhs(stmt));
+		break;
+	case flat::Kind::scope:
+		resolve_statements(stmt);
+		break;
+	default:
+		break;
+	}
+}
+
+void Resolver::resolve_expr(flat::Index expr)
+{
+	for (flat::Index node = m_ast->first(expr); node <= expr; node++) {
+		if (m_ast->kind(node) != flat::Kind::var)
+			continue;
+
+		Symbol symbol = m_ast->lhs(node);
+		expect_declared(symbol);
+
+		m_ast->set_operand(node, m_bindings[symbol], 0);
+	}
+}
+
+// Walks the program as parsed, without binding slots, so the errors are the
+// ones resolve() would report in the same order
+void Resolver::check_statements(const flat::Ast& ast, flat::Index scope)
+{
+	begin_scope();
+
+	for (flat::Index stmt : ast.statements(scope))
+		check_statement(ast, stmt);
+
+	end_scope();
+}
+
+void Resolver::check_statement(const flat::Ast& ast, flat::Index stmt)
+{
+	switch (ast.kind(stmt)) {
+	case flat::Kind::exit:
+		check_expr(ast, ast.lhs(stmt));
+		break;
+	case flat::Kind::let:
+	{
+		Symbol symbol = ast.rhs(stmt);
+		expect_undeclared(symbol);
+		check_expr(ast, ast.lhs(stmt));
+
+		m_bindings[symbol] = m_slot_count++;
+		m_declared.push_back(symbol);
+		break;
+	}
+	case flat::Kind::if_:
+		check_expr(ast, ast.lhs(stmt));
+		check_statements(ast, ast.rhs(stmt));
+		break;
+	case flat::Kind::scope:
+		check_statements(ast, stmt);
+		break;
+	default:
+		break;
+	}
+}
+
+void Resolver::check_expr(const flat::Ast& ast, flat::Index expr)
+{
+	for (flat::Index node = ast.first(expr); node <= expr; node++) {
+		if (ast.kind(node) == flat::Kind::var)
+			expect_declared(ast.lhs(node));
+		else if (ast.kind(node) == flat::Kind::int_lit)
+			expect_fits(ast, node);
+	}
+}
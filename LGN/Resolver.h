@@ -0,0 +1,58 @@
+#pragma once
+#include "FlatAst.h"
+#include "Interner.h"
+
+namespace lgn
+{
+	// Binds every variable use to the let that declares it before code
+	// generation. Each let gets its own slot number, and the symbols in var
+	// and let nodes are replaced by that slot, so the Assembler only
+	// indexes arrays. Redeclarations, undeclared identifiers and literals
+	// that do not fit in 64 bits are reported here, or by check() on the
+	// parsed program, before the optimizer removes code they may be in. A
+	// Resolver can be used for one Ast after another.
+	class Resolver
+	{
+	public:
+		explicit Resolver(const Interner& interner) : m_interner(interner) {}
+
+		void resolve(flat::Ast& ast);
+
+		// Reports the errors resolve() would on the program as parsed, so
+		// they do not depend on the optimization level
+		void check(const flat::Ast& ast);
+
+		// Declares a variable of the statements before the next Ast, for
+		// resolving part of a program on its own. Returns its slot.
+		flat::Index bind(Symbol symbol);
+
+	private:
+		static constexpr flat::Index unbound = UINT32_MAX;
+
+		flat::Ast* m_ast = nullptr;
+		const Interner& m_interner;
+
+		// Slot currently bound to each symbol, indexed by symbol id
+		std::vector<flat::Index> m_bindings {};
+
+		// Symbols declared in the open scopes, innermost last
+		std::vector<Symbol> m_declared {};
+		std::vector<size_t> m_scopes {};
+
+		flat::Index m_slot_count = 0;
+
+		void forget();
+		void begin_scope();
+		void end_scope();
+		void expect_undeclared(Symbol symbol) const;
+		void expect_declared(Symbol symbol) const;
+		void expect_fits(const flat::Ast& ast, flat::Index int_lit) const;
+
+		void check_statements(const flat::Ast& ast, flat::Index scope);
+		void check_statement(const flat::Ast& ast, flat::Index stmt);
+		void check_expr(const flat::Ast& ast, flat::Index expr);
+		void resolve_statements(flat::Index scope);
+		void resolve_statement(flat::Index stmt);
+		void resolve_expr(flat::Index expr);
+	};
+}
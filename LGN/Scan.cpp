@@ -0,0 +1,226 @@
+#include "Scan.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define LGN_SCAN_X86 1
+#endif
+
+using namespace lgn;
+
+namespace
+{
+    inline bool is_space(char c)
+    {
+        return c == ' ' || static_cast<uint8_t>(c - '\t') <= '\r' - '\t';
+    }
+
+    inline bool is_digit(char c)
+    {
+        return static_cast<uint8_t>(c - '0') <= 9;
+    }
+
+    inline bool is_ident(char c)
+    {
+        return is_digit(c) || static_cast<uint8_t>((c | 0x20) - 'a') <= 'z' - 'a';
+    }
+
+    const char* scalar_skip_space(const char* p, const char* end)
+    {
+        while (p < end && is_space(*p))
+            p++;
+
+        return p;
+    }
+
+    const char* scalar_skip_ident(const char* p, const char* end)
+    {
+        while (p < end && is_ident(*p))
+            p++;
+
+        return p;
+    }
+
+    const char* scalar_skip_digits(const char* p, const char* end)
+    {
+        while (p < end && is_digit(*p))
+            p++;
+
+        return p;
+    }
+
+    const char* scalar_find_newline(const char* p, const char* end)
+    {
+        const void* newline = memchr(p, '\n', end - p);
+        return newline ? static_cast<const char*>(newline) : end;
+    }
+
+    const scan::Kernels scalar = {
+        .skip_space = scalar_skip_space,
+        .skip_ident = scalar_skip_ident,
+        .skip_digits = scalar_skip_digits,
+        .find_newline = scalar_find_newline,
+        .name = "scalar",
+    };
+
+#ifdef LGN_SCAN_X86
+    // The vector kernels build a byte mask of the characters that continue
+    // the run, stop at the first block with a clear bit and leave the last
+    // partial block to the scalar loop so they never read past the input.
+
+    inline __m128i sse2_in_range(__m128i x, char lo, char hi)
+    {
+        __m128i d = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+        return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(hi - lo)), d);
+    }
+
+    inline __m128i sse2_space(__m128i x)
+    {
+        return _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), sse2_in_range(x, '\t', '\r'));
+    }
+
+    inline __m128i sse2_digit(__m128i x)
+    {
+        return sse2_in_range(x, '0', '9');
+    }
+
+    inline __m128i sse2_ident(__m128i x)
+    {
+        __m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+        return _mm_or_si128(sse2_digit(x), sse2_in_range(lower, 'a', 'z'));
+    }
+
+    inline __m128i sse2_not_newline(__m128i x)
+    {
+        return _mm_xor_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')), _mm_set1_epi8(-1));
+    }
+
+    template <__m128i (*Pred)(__m128i), const char* (*Tail)(const char*, const char*)>
+    const char* sse2_skip(const char* p, const char* end)
+    {
+        while (end - p >= 16) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            unsigned stop = ~static_cast<unsigned>(_mm_movemask_epi8(Pred(x))) & 0xFFFF;
+
+            if (stop)
+                return p + __builtin_ctz(stop);
+
+            p += 16;
+        }
+
+        return Tail(p, end);
+    }
+
+    const scan::Kernels sse2 = {
+        .skip_space = sse2_skip<sse2_space, scalar_skip_space>,
+        .skip_ident = sse2_skip<sse2_ident, scalar_skip_ident>,
+        .skip_digits = sse2_skip<sse2_digit, scalar_skip_digits>,
+        .find_newline = sse2_skip<sse2_not_newline, scalar_find_newline>,
+        .name = "sse2",
+    };
+
+#define LGN_AVX2 __attribute__((target("avx2")))
+
+    LGN_AVX2 inline __m256i avx2_in_range(__m256i x, char lo, char hi)
+    {
+        __m256i d = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+        return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(hi - lo)), d);
+    }
+
+    LGN_AVX2 inline __m256i avx2_space(__m256i x)
+    {
+        return _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), avx2_in_range(x, '\t', '\r'));
+    }
+
+    LGN_AVX2 inline __m256i avx2_digit(__m256i x)
+    {
+        return avx2_in_range(x, '0', '9');
+    }
+
+    LGN_AVX2 inline __m256i avx2_ident(__m256i x)
+    {
+        __m256i lower = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+        return _mm256_or_si256(avx2_digit(x), avx2_in_range(lower, 'a', 'z'));
+    }
+
+    LGN_AVX2 inline __m256i avx2_not_newline(__m256i x)
+    {
+        return _mm256_xor_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')), _mm256_set1_epi8(-1));
+    }
+
+    template <__m256i (*Pred)(__m256i), const char* (*Tail)(const char*, const char*)>
+    LGN_AVX2 const char* avx2_skip(const char* p, const char* end)
+    {
+        while (end - p >= 32) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            unsigned stop = ~static_cast<unsigned>(_mm256_movemask_epi8(Pred(x)));
+
+            if (stop)
+                return p + __builtin_ctz(stop);
+
+            p += 32;
+        }
+
+        return Tail(p, end);
+    }
+
+    const scan::Kernels avx2 = {
+        .skip_space = avx2_skip<avx2_space, sse2_skip<sse2_space, scalar_skip_space>>,
+        .skip_ident = avx2_skip<avx2_ident, sse2_skip<sse2_ident, scalar_skip_ident>>,
+        .skip_digits = avx2_skip<avx2_digit, sse2_skip<sse2_digit, scalar_skip_digits>>,
+        .find_newline = avx2_skip<avx2_not_newline, sse2_skip<sse2_not_newline, scalar_find_newline>>,
+        .name = "avx2",
+    };
+#endif
+
+    const scan::Kernels& select_kernels()
+    {
+        const char* forced = getenv("LGN_SIMD");
+
+        if (forced && strcmp(forced, "scalar") == 0)
+            return scalar;
+
+#ifdef LGN_SCAN_X86
+        if (forced && strcmp(forced, "sse2") == 0)
+            return sse2;
+
+        if (__builtin_cpu_supports("avx2"))
+            return avx2;
+
+        return sse2;
+#else
+        return scalar;
+#endif
+    }
+}
+
+const scan::Kernels& scan::kernels()
+{
+    static const Kernels& selected = select_kernels();
+    return selected;
+}
+
+const scan::Kernels& scan::scalar_kernels()
+{
+    return scalar;
+}
+
+const scan::Kernels* scan::sse2_kernels()
+{
+#ifdef LGN_SCAN_X86
+    return &sse2;
+#else
+    return nullptr;
+#endif
+}
+
+const scan::Kernels* scan::avx2_kernels()
+{
+#ifdef LGN_SCAN_X86
+    return __builtin_cpu_supports("avx2") ? &avx2 : nullptr;
+#else
+    return nullptr;
+#endif
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+namespace lgn::scan
+{
+    // Run-skipping kernels used by the lexer. Each one returns the first
+    // position in [p, end) that does not belong to the run it skips.
+    struct Kernels {
+        const char* (*skip_space)(const char* p, const char* end);
+        const char* (*skip_ident)(const char* p, const char* end);
+        const char* (*skip_digits)(const char* p, const char* end);
+        const char* (*find_newline)(const char* p, const char* end);
+        const char* name;
+    };
+
+    // Best implementation for the running CPU (AVX2, SSE2 or scalar),
+    // chosen once. LGN_SIMD=scalar|sse2|avx2 forces a specific one.
+    const Kernels& kernels();
+
+    const Kernels& scalar_kernels();
+    const Kernels* sse2_kernels();
+    const Kernels* avx2_kernels();
+}
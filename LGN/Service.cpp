@@ -0,0 +1,436 @@
+#include "Service.h"
+#include "Error.h"
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+using namespace lgn;
+using namespace lgn::service;
+
+namespace
+{
+	// Every message is a 32-bit length and a payload that starts with this,
+	// so a client and server from different versions fail cleanly
+	constexpr uint32_t protocol_magic = 0x4c474e01;
+
+	// Anything larger is a broken or hostile peer
+	constexpr uint32_t max_message = 1u << 30;
+
+	// A client that connects and sends nothing gives its worker back after this
+	constexpr int receive_timeout_seconds = 30;
+
+	class Writer
+	{
+	public:
+		Writer() { u32(protocol_magic); }
+
+		void u32(uint32_t value) { m_data.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+
+		void str(std::string_view text)
+		{
+			u32(static_cast<uint32_t>(text.size()));
+			m_data.append(text);
+		}
+
+		inline const std::string& data() const { return m_data; }
+
+	private:
+		std::string m_data;
+	};
+
+	class Reader
+	{
+	public:
+		explicit Reader(std::string_view data) : m_data(data)
+		{
+			if (u32() != protocol_magic)
+				throw std::runtime_error("lgn server and client versions differ");
+		}
+
+		uint32_t u32()
+		{
+			uint32_t value;
+			memcpy(&value, take(sizeof(value)).data(), sizeof(value));
+			return value;
+		}
+
+		std::string_view str() { return take(u32()); }
+
+		// The number of items that follow, each at least item_size bytes.
+		// Checked against what is left, so a bad count cannot make the
+		// reader allocate more than the message could describe.
+		uint32_t count(size_t item_size)
+		{
+			uint32_t value = u32();
+
+			if (value > m_data.size() / item_size)
+				throw std::runtime_error("Malformed message");
+
+			return value;
+		}
+
+	private:
+		std::string_view m_data;
+
+		std::string_view take(size_t size)
+		{
+			if (size > m_data.size())
+				throw std::runtime_error("Malformed message");
+
+			std::string_view part = m_data.substr(0, size);
+			m_data.remove_prefix(size);
+			return part;
+		}
+	};
+
+	bool write_all(int fd, const char* data, size_t size)
+	{
+		while (size > 0) {
+			ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+
+			if (written < 0 && errno == EINTR)
+				continue;
+
+			if (written <= 0)
+				return false;
+
+			data += written;
+			size -= written;
+		}
+
+		return true;
+	}
+
+	bool read_all(int fd, char* data, size_t size)
+	{
+		while (size > 0) {
+			ssize_t got = recv(fd, data, size, 0);
+
+			if (got < 0 && errno == EINTR)
+				continue;
+
+			if (got <= 0)
+				return false;
+
+			data += got;
+			size -= got;
+		}
+
+		return true;
+	}
+
+	bool send_message(int fd, const std::string& payload)
+	{
+		uint32_t size = static_cast<uint32_t>(payload.size());
+
+		return write_all(fd, reinterpret_cast<const char*>(&size), sizeof(size))
+			&& write_all(fd, payload.data(), payload.size());
+	}
+
+	bool receive_message(int fd, std::string& payload)
+	{
+		uint32_t size;
+
+		if (!read_all(fd, reinterpret_cast<char*>(&size), sizeof(size)) || size > max_message)
+			return false;
+
+		payload.resize(size);
+		return read_all(fd, payload.data(), size);
+	}
+
+	bool make_address(const std::string& path, sockaddr_un& address)
+	{
+		address = {};
+		address.sun_family = AF_UNIX;
+
+		if (path.size() >= sizeof(address.sun_path)) {
+			errno = ENAMETOOLONG;
+			return false;
+		}
+
+		memcpy(address.sun_path, path.c_str(), path.size() + 1);
+		return true;
+	}
+
+	// A connected socket, -1 with errno set if nothing listens on path
+	int connect_to(const std::string& path)
+	{
+		sockaddr_un address;
+
+		if (!make_address(path, address))
+			return -1;
+
+		int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+		if (fd < 0)
+			return -1;
+
+		if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+			int error = errno;
+			close(fd);
+			errno = error;
+			return -1;
+		}
+
+		return fd;
+	}
+
+	Request decode_request(std::string_view payload)
+	{
+		Reader reader(payload);
+		Request request;
+
+		request.directory = reader.str();
+		request.opt_level = static_cast<int>(reader.u32());
+		request.verbose = reader.u32();
+		request.use_nasm = reader.u32();
+		request.pipeline = reader.u32();
+		request.use_cache = reader.u32();
+		request.batch = reader.u32();
+		// A name and has_source at least
+		request.inputs.resize(reader.count(2 * sizeof(uint32_t)));
+
+		for (Request::Input& input : request.inputs) {
+			input.name = reader.str();
+			input.has_source = reader.u32();
+
+			if (input.has_source)
+				input.source = reader.str();
+		}
+
+		return request;
+	}
+
+	std::string encode_request(const Request& request)
+	{
+		Writer writer;
+
+		writer.str(request.directory);
+		writer.u32(static_cast<uint32_t>(request.opt_level));
+		writer.u32(request.verbose);
+		writer.u32(request.use_nasm);
+		writer.u32(request.pipeline);
+		writer.u32(request.use_cache);
+		writer.u32(request.batch);
+		writer.u32(static_cast<uint32_t>(request.inputs.size()));
+
+		for (const Request::Input& input : request.inputs) {
+			writer.str(input.name);
+			writer.u32(input.has_source);
+
+			if (input.has_source)
+				writer.str(input.source);
+		}
+
+		return writer.data();
+	}
+}
+
+std::string service::default_socket()
+{
+	if (const char* dir = getenv("XDG_RUNTIME_DIR"); dir && *dir)
+		return std::string(dir) + "/lgn.sock";
+
+	return "/tmp/lgn-" + std::to_string(getuid()) + ".sock";
+}
+
+Server::Server(std::string socket_path, Cache* cache, size_t thread_count)
+	: m_path(std::move(socket_path)), m_cache(cache), m_thread_count(std::max<size_t>(thread_count, 1))
+{
+}
+
+Server::~Server()
+{
+	if (m_fd >= 0)
+		close(m_fd);
+}
+
+bool Server::listen()
+{
+	sockaddr_un address;
+
+	if (!make_address(m_path, address))
+		return false;
+
+	// A socket file nobody answers on is left over from a server that died
+	if (int fd = connect_to(m_path); fd >= 0) {
+		close(fd);
+		errno = EADDRINUSE;
+		return false;
+	}
+
+	unlink(m_path.c_str());
+
+	m_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if (m_fd < 0)
+		return false;
+
+	// Only the owner may connect, the server writes files with their rights
+	mode_t mask = umask(0077);
+	bool bound = bind(m_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+	umask(mask);
+
+	return bound && ::listen(m_fd, SOMAXCONN) == 0;
+}
+
+void Server::run()
+{
+	std::vector<std::thread> workers;
+
+	for (size_t i = 0; i < m_thread_count; i++)
+		workers.emplace_back([this] { work(); });
+
+	while (!m_stopping.load()) {
+		int fd = accept4(m_fd, nullptr, nullptr, SOCK_CLOEXEC);
+
+		if (fd < 0) {
+			// Out of descriptors or an aborted connection, neither is fatal
+			if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE)
+				continue;
+
+			break;
+		}
+
+		timeval timeout { .tv_sec = receive_timeout_seconds, .tv_usec = 0 };
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		std::lock_guard lock(m_mutex);
+		m_connections.push_back(fd);
+		m_ready.notify_one();
+	}
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_done = true;
+		m_ready.notify_all();
+	}
+
+	for (std::thread& worker : workers)
+		worker.join();
+
+	unlink(m_path.c_str());
+}
+
+void Server::stop()
+{
+	m_stopping.store(true);
+
+	// Wakes the accept() in run()
+	if (m_fd >= 0)
+		shutdown(m_fd, SHUT_RDWR);
+}
+
+void Server::work()
+{
+	Options options;
+	Compiler compiler(options, m_cache);
+
+	for (;;) {
+		int fd;
+
+		{
+			std::unique_lock lock(m_mutex);
+			m_ready.wait(lock, [this] { return m_done || !m_connections.empty(); });
+
+			if (m_connections.empty())
+				return;
+
+			fd = m_connections.front();
+			m_connections.pop_front();
+		}
+
+		try {
+			serve(fd, compiler, options);
+		} catch (const std::exception&) {
+			// A malformed request, the client only sees the connection close
+		}
+
+		close(fd);
+	}
+}
+
+void Server::serve(int fd, Compiler& compiler, Options& options)
+{
+	std::string payload;
+
+	if (!receive_message(fd, payload))
+		return;
+
+	Request request = decode_request(payload);
+
+	options = {
+		.opt_level = request.opt_level,
+		.verbose = request.verbose,
+		.use_nasm = request.use_nasm,
+		.pipeline = request.pipeline,
+		.batch = request.batch,
+		.directory = request.directory,
+	};
+	compiler.set_cache(request.use_cache ? m_cache : nullptr);
+
+	Writer writer;
+	writer.u32(static_cast<uint32_t>(request.inputs.size()));
+
+	for (const Request::Input& input : request.inputs) {
+		std::ostringstream log;
+		options.log = &log;
+
+		Status status = Status::ok;
+		std::string output;
+
+		// Reported the way main() does for a local compile
+		try {
+			if (input.has_source)
+				compiler.compile(input.name, input.source);
+			else
+				compiler.compile(input.name);
+
+			output = compiler.output_path(input.name);
+		} catch (const CompileError& error) {
+			status = Status::compile_error;
+			log << (request.batch ? input.name + ": " : "") << error.what() << "\n";
+		} catch (const std::exception& error) {
+			status = Status::failure;
+			log << (request.batch ? input.name + ": " : "") << error.what() << "\n";
+		}
+
+		writer.u32(static_cast<uint32_t>(status));
+		writer.str(log.str());
+		writer.str(output);
+	}
+
+	options.log = &std::cerr;
+	send_message(fd, writer.data());
+}
+
+std::vector<Result> service::submit(const std::string& socket_path, const Request& request)
+{
+	int fd = connect_to(socket_path);
+
+	if (fd < 0)
+		throw std::runtime_error("No lgn server on '" + socket_path + "': " + strerror(errno));
+
+	std::string payload;
+	bool ok = send_message(fd, encode_request(request)) && receive_message(fd, payload);
+	close(fd);
+
+	if (!ok)
+		throw std::runtime_error("The lgn server on '" + socket_path + "' closed the connection");
+
+	Reader reader(payload);
+	// A status, diagnostics and output at least
+	std::vector<Result> results(reader.count(3 * sizeof(uint32_t)));
+
+	for (Result& result : results) {
+		result.status = static_cast<Status>(reader.u32());
+		result.diagnostics = reader.str();
+		result.output = reader.str();
+	}
+
+	return results;
+}
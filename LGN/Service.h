@@ -0,0 +1,95 @@
+#pragma once
+#include "Cache.h"
+#include "Compiler.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace lgn::service
+{
+	// What one lgn command line asks for. Relative paths are relative to
+	// directory, the client's working directory.
+	struct Request {
+		struct Input {
+			std::string name;
+			// The source itself, sent instead of a path (for stdin)
+			bool has_source = false;
+			std::string source {};
+		};
+
+		std::string directory;
+		int opt_level = 0;
+		bool verbose = false;
+		bool use_nasm = false;
+		bool pipeline = false;
+		bool use_cache = true;
+		bool batch = false;
+		std::vector<Input> inputs;
+	};
+
+	enum class Status : uint32_t {
+		ok,
+		compile_error,
+		failure
+	};
+
+	// One per input, in the order of the request
+	struct Result {
+		Status status = Status::ok;
+		// The -v reports and the error, as lgn itself would print them
+		std::string diagnostics {};
+		// The executable that was written, empty if compiling failed
+		std::string output {};
+	};
+
+	// $XDG_RUNTIME_DIR/lgn.sock, or /tmp/lgn-<uid>.sock without one
+	std::string default_socket();
+
+	// Compiles for clients on a local socket, so a build that runs lgn
+	// thousands of times pays for process startup and warming up the
+	// allocators once. Every worker thread keeps its Compiler, arenas and
+	// buffers included, from one request to the next. A bad input only
+	// fails its own Result; the server keeps going.
+	class Server
+	{
+	public:
+		Server(std::string socket_path, Cache* cache, size_t thread_count);
+		~Server();
+
+		Server(const Server& other) = delete;
+		Server& operator=(const Server& other) = delete;
+
+		// Creates the socket. False with errno set if it cannot, EADDRINUSE
+		// if another server is listening on it.
+		bool listen();
+
+		// Serves requests until stop(), then removes the socket
+		void run();
+
+		// Safe to call from a signal handler
+		void stop();
+
+	private:
+		std::string m_path;
+		Cache* m_cache;
+		size_t m_thread_count;
+		int m_fd = -1;
+		std::atomic<bool> m_stopping { false };
+
+		std::mutex m_mutex;
+		std::condition_variable m_ready;
+		std::deque<int> m_connections;
+		bool m_done = false;
+
+		void work();
+		void serve(int fd, Compiler& compiler, Options& options);
+	};
+
+	// Sends request to the server on socket_path and waits for its results.
+	// Throws std::runtime_error if no server answers.
+	std::vector<Result> submit(const std::string& socket_path, const Request& request);
+}
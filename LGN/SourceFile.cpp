@@ -0,0 +1,46 @@
+#include "SourceFile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace lgn;
+
+SourceFile::SourceFile(const char* path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return;
+
+    struct stat st;
+
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return;
+    }
+
+    // mmap rejects zero-length mappings, an empty file is just an empty view
+    if (st.st_size > 0) {
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data == MAP_FAILED) {
+            close(fd);
+            return;
+        }
+
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+        m_data = static_cast<const char*>(data);
+        m_size = st.st_size;
+        m_mapped = true;
+    }
+
+    close(fd);
+    m_open = true;
+}
+
+SourceFile::~SourceFile()
+{
+    if (m_mapped)
+        munmap(const_cast<char*>(m_data), m_size);
+}
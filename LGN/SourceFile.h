@@ -0,0 +1,27 @@
+#pragma once
+#include <string_view>
+
+namespace lgn
+{
+    // Read-only, memory-mapped view of an input file. The mapping lives as
+    // long as the SourceFile, so the lexer and the tokens it produces can
+    // point straight into it instead of copying the text.
+    class SourceFile {
+    public:
+        explicit SourceFile(const char* path);
+
+        SourceFile(const SourceFile& other) = delete;
+        SourceFile& operator=(const SourceFile& other) = delete;
+
+        ~SourceFile();
+
+        inline bool is_open() const { return m_open; }
+        inline std::string_view view() const { return { m_data, m_size }; }
+
+    private:
+        const char* m_data = "";
+        size_t m_size = 0;
+        bool m_open = false;
+        bool m_mapped = false;
+    };
+}
@@ -0,0 +1,72 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <thread>
+using namespace lgn;
+
+ThreadPool::ThreadPool(size_t thread_count)
+{
+	m_queues.resize(std::max<size_t>(thread_count, 1));
+
+	for (auto& queue : m_queues)
+		queue = std::make_unique<Queue>();
+}
+
+void ThreadPool::run(size_t count, const Job& job)
+{
+	// Consecutive jobs go to the same worker
+	size_t share = (count + m_queues.size() - 1) / m_queues.size();
+
+	for (size_t i = 0; i < count; i++)
+		m_queues[i / share]->jobs.push_back(i);
+
+	std::vector<std::thread> threads;
+	threads.reserve(m_queues.size() - 1);
+
+	for (size_t worker = 1; worker < m_queues.size(); worker++)
+		threads.emplace_back([this, worker, &job] { work(worker, job); });
+
+	work(0, job);
+
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+void ThreadPool::work(size_t worker, const Job& job)
+{
+	// Jobs are only added before the threads start, so once every queue is
+	// empty there is nothing left to wait for
+	while (auto index = take(worker))
+		job(*index, worker);
+}
+
+std::optional<size_t> ThreadPool::take(size_t worker)
+{
+	{
+		Queue& own = *m_queues[worker];
+		std::lock_guard lock(own.mutex);
+
+		if (!own.jobs.empty()) {
+			size_t index = own.jobs.front();
+			own.jobs.pop_front();
+			return index;
+		}
+	}
+
+	return steal(worker);
+}
+
+std::optional<size_t> ThreadPool::steal(size_t worker)
+{
+	for (size_t i = 1; i < m_queues.size(); i++) {
+		Queue& victim = *m_queues[(worker + i) % m_queues.size()];
+		std::lock_guard lock(victim.mutex);
+
+		if (!victim.jobs.empty()) {
+			size_t index = victim.jobs.back();
+			victim.jobs.pop_back();
+			return index;
+		}
+	}
+
+	return std::nullopt;
+}
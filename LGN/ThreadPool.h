@@ -0,0 +1,43 @@
+#pragma once
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace lgn
+{
+	// Runs a batch of independent jobs on a fixed number of threads. Each
+	// worker starts with its own share of the jobs and takes them from the
+	// front of its queue; once that is empty it steals from the back of
+	// another worker's queue, so a few large inputs don't leave the other
+	// threads idle while one worker is still busy.
+	class ThreadPool
+	{
+	public:
+		using Job = std::function<void(size_t index, size_t worker)>;
+
+		explicit ThreadPool(size_t thread_count);
+
+		inline size_t thread_count() const { return m_queues.size(); }
+
+		// Calls job for every index in [0, count) and returns once all of
+		// them are done. worker is in [0, thread_count()) and names the
+		// calling thread, so per-thread state can be indexed by it. The
+		// calling thread is worker 0. Jobs must not throw.
+		void run(size_t count, const Job& job);
+
+	private:
+		struct Queue {
+			std::mutex mutex;
+			std::deque<size_t> jobs;
+		};
+
+		std::vector<std::unique_ptr<Queue>> m_queues;
+
+		void work(size_t worker, const Job& job);
+		std::optional<size_t> take(size_t worker);
+		std::optional<size_t> steal(size_t worker);
+	};
+}
@@ -1,9 +1,11 @@
 #pragma once
-#include <optional>
-#include <string>
+#include <cstdint>
+#include <type_traits>
 
-enum class TokenType {
-    tok_kw,
+enum class TokenType : uint8_t {
+    tok_exit,
+    tok_let,
+    tok_if,
     tok_int,
     tok_semi,
     tok_lparen,
@@ -19,7 +21,21 @@ enum class TokenType {
     tok_mod
 };
 
+// Plain 16 bytes: lexing allocates nothing per token and the parser copies
+// them around in registers. Identifiers carry the symbol lgn::Interner gave
+// their text, integer literals their value; the span in the source is kept
+// for diagnostics.
 struct Token {
     TokenType type;
-    std::optional<std::string> value {};
+    // An integer literal that does not fit in 64 bits, an error
+    // Resolver::check() reports. symbol is then its text.
+    bool overflow = false;
+    uint16_t length = 0;
+    uint32_t offset = 0;
+    union {
+        uint64_t value = 0;
+        uint32_t symbol;
+    };
 };
+
+static_assert(sizeof(Token) == 16 && std::is_trivially_copyable_v<Token>);
@@ -0,0 +1,102 @@
+#include "TokenRing.h"
+#include <algorithm>
+#include <bit>
+using namespace lgn;
+
+TokenRing::TokenRing(size_t capacity)
+	: m_tokens(std::make_unique<Token[]>(std::bit_ceil(std::max(capacity, publish_batch))))
+	, m_mask(std::bit_ceil(std::max(capacity, publish_batch)) - 1)
+{
+}
+
+void TokenRing::push(const Token& token)
+{
+	if (m_write - m_producer_head > m_mask) {
+		publish();
+
+		for (;;) {
+			// Read the counter first, a read() after this changes it and the wait returns
+			uint32_t consumed = m_consumed.load();
+
+			if (m_cancelled.load(std::memory_order_acquire))
+				return;
+
+			m_producer_head = m_head.load(std::memory_order_acquire);
+
+			if (m_write - m_producer_head <= m_mask)
+				break;
+
+			m_consumed.wait(consumed);
+		}
+	}
+
+	m_tokens[m_write & m_mask] = token;
+	m_write++;
+
+	if (m_write - m_tail.load(std::memory_order_relaxed) >= publish_batch)
+		publish();
+}
+
+void TokenRing::publish()
+{
+	m_tail.store(m_write, std::memory_order_release);
+	m_published.fetch_add(1);
+	m_published.notify_one();
+}
+
+void TokenRing::close()
+{
+	m_tail.store(m_write, std::memory_order_release);
+	m_closed.store(true, std::memory_order_release);
+	m_published.fetch_add(1);
+	m_published.notify_one();
+}
+
+void TokenRing::fail(std::exception_ptr error)
+{
+	m_error = error;
+	close();
+}
+
+size_t TokenRing::read(Token* out, size_t capacity)
+{
+	for (;;) {
+		// Read the counter first, a publish after this changes it and the wait returns
+		uint32_t published = m_published.load();
+		bool closed = m_closed.load(std::memory_order_acquire);
+		size_t tail = m_tail.load(std::memory_order_acquire);
+		size_t count = std::min(capacity, tail - m_read);
+
+		if (count > 0) {
+			size_t start = m_read & m_mask;
+			size_t first = std::min(count, m_mask + 1 - start);
+
+			std::copy_n(m_tokens.get() + start, first, out);
+			std::copy_n(m_tokens.get(), count - first, out + first);
+
+			m_read += count;
+			m_head.store(m_read, std::memory_order_release);
+			m_consumed.fetch_add(1);
+			m_consumed.notify_one();
+
+			return count;
+		}
+
+		// The final tail is stored before closing, so nothing is left behind
+		if (closed) {
+			if (m_error)
+				std::rethrow_exception(m_error);
+
+			return 0;
+		}
+
+		m_published.wait(published);
+	}
+}
+
+void TokenRing::cancel()
+{
+	m_cancelled.store(true, std::memory_order_release);
+	m_consumed.fetch_add(1);
+	m_consumed.notify_one();
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "TokenSource.h"
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace lgn
+{
+	// Bounded queue of tokens from one lexer thread to one parser thread.
+	// Each side only writes its own position and reads the other's, so no
+	// locks are taken. The producer publishes tokens in batches to keep
+	// the two cache lines from bouncing on every token, and a side only
+	// sleeps when the ring is full or empty.
+	class TokenRing : public TokenSource
+	{
+	public:
+		// Rounded up to a power of two
+		explicit TokenRing(size_t capacity = default_capacity);
+
+		TokenRing(const TokenRing& other) = delete;
+		TokenRing& operator=(const TokenRing& other) = delete;
+
+		// Producer side. Once the consumer has cancelled, tokens are dropped
+		void push(const Token& token);
+		void close();
+		// Ends the input with an error, which read() rethrows
+		void fail(std::exception_ptr error);
+
+		// Consumer side
+		size_t read(Token* out, size_t capacity) override;
+		void cancel();
+
+		// The producer's error, if it failed. Only valid once it is done.
+		inline std::exception_ptr error() const { return m_error; }
+
+		static constexpr size_t default_capacity = 4096;
+		static constexpr size_t publish_batch = 64;
+
+	private:
+		std::unique_ptr<Token[]> m_tokens;
+		size_t m_mask;
+		std::exception_ptr m_error;
+
+		// Written by the producer
+		alignas(64) std::atomic<size_t> m_tail { 0 };
+		std::atomic<uint32_t> m_published { 0 };
+		std::atomic<bool> m_closed { false };
+
+		// Written by the consumer
+		alignas(64) std::atomic<size_t> m_head { 0 };
+		std::atomic<uint32_t> m_consumed { 0 };
+		std::atomic<bool> m_cancelled { false };
+
+		// Private to the producer
+		alignas(64) size_t m_write = 0;
+		size_t m_producer_head = 0;
+
+		// Private to the consumer
+		alignas(64) size_t m_read = 0;
+
+		void publish();
+	};
+}
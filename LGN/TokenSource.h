@@ -0,0 +1,41 @@
+#pragma once
+#include "Token.h"
+#include <algorithm>
+#include <cstddef>
+#include <span>
+
+namespace lgn
+{
+	// Where the parser takes its tokens from. They are handed over a batch
+	// at a time, so the parser only holds a small window of them and does
+	// not care whether they were lexed up front or are still being lexed.
+	class TokenSource
+	{
+	public:
+		virtual ~TokenSource() = default;
+
+		// Copies up to capacity tokens to out and returns how many, 0 once
+		// the input has ended
+		virtual size_t read(Token* out, size_t capacity) = 0;
+	};
+
+	// Tokens that were all lexed before parsing
+	class TokenSpan : public TokenSource
+	{
+	public:
+		explicit TokenSpan(std::span<const Token> tokens) : m_tokens(tokens) {}
+
+		inline size_t read(Token* out, size_t capacity) override
+		{
+			size_t count = std::min(capacity, m_tokens.size() - m_next);
+			std::copy_n(m_tokens.begin() + m_next, count, out);
+			m_next += count;
+
+			return count;
+		}
+
+	private:
+		std::span<const Token> m_tokens;
+		size_t m_next = 0;
+	};
+}
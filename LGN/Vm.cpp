@@ -0,0 +1,95 @@
+#include "Vm.h"
+using namespace lgn;
+using namespace lgn::vm;
+
+// GCC and Clang can jump through a table of label addresses, which gives
+// every instruction its own indirect branch and lets the predictor learn
+// which instruction tends to follow which. Other compilers get a switch,
+// as does a build with LGN_VM_SWITCH defined, for comparison.
+#if defined(__GNUC__) && !defined(LGN_VM_SWITCH)
+#define LGN_VM_THREADED 1
+#else
+#define LGN_VM_THREADED 0
+#endif
+
+#if LGN_VM_THREADED
+#define VM_CASE(name) op_##name:
+#define VM_DISPATCH() goto *labels[static_cast<size_t>(ip->op)]
+#define VM_NEXT() do { ip++; VM_DISPATCH(); } while (0)
+#else
+#define VM_CASE(name) case Op::name:
+#define VM_DISPATCH() continue
+#define VM_NEXT() { ip++; continue; }
+#endif
+
+// Binary operators work on the top of the stack in place
+#define VM_BINARY(name, expr)												\
+	VM_CASE(name) { uint64_t b = *sp--; uint64_t& a = *sp; a = (expr); VM_NEXT(); }	\
+	VM_CASE(name##_const) { uint64_t b = constants[ip->a]; uint64_t& a = *sp; a = (expr); VM_NEXT(); }	\
+	VM_CASE(name##_slot) { uint64_t b = slots[ip->a]; uint64_t& a = *sp; a = (expr); VM_NEXT(); }
+
+#define VM_DIVIDE(name)													\
+	VM_CASE(name) { uint64_t b = *sp--; if (b == 0) return trap(); *sp /= b; VM_NEXT(); }	\
+	VM_CASE(name##_const) { uint64_t b = constants[ip->a]; if (b == 0) return trap(); *sp /= b; VM_NEXT(); }	\
+	VM_CASE(name##_slot) { uint64_t b = slots[ip->a]; if (b == 0) return trap(); *sp /= b; VM_NEXT(); }
+
+Result Machine::run(const Program& program)
+{
+	m_slots.assign(program.slot_count, 0);
+	m_stack.resize(program.stack_size + 1);
+
+	const Instr* code = program.code.data();
+	const Instr* ip = code;
+	const uint64_t* constants = program.constants.data();
+	uint64_t* slots = m_slots.data();
+
+	// sp points at the top value, the first element is never used
+	uint64_t* sp = m_stack.data();
+
+	auto trap = [] { return Result{ .value = 0, .divided_by_zero = true }; };
+
+#if LGN_VM_THREADED
+	// In Op order
+	static const void* const labels[] = {
+		&&op_push_const, &&op_push_slot,
+		&&op_add, &&op_sub, &&op_mul, &&op_div,
+		&&op_add_const, &&op_sub_const, &&op_mul_const, &&op_div_const,
+		&&op_add_slot, &&op_sub_slot, &&op_mul_slot, &&op_div_slot,
+		&&op_store, &&op_jz, &&op_exit,
+	};
+	static_assert(sizeof(labels) / sizeof(labels[0]) == op_count);
+
+	VM_DISPATCH();
+#else
+	for (;;) {
+		switch (ip->op) {
+#endif
+
+	VM_CASE(push_const) { *++sp = constants[ip->a]; VM_NEXT(); }
+	VM_CASE(push_slot) { *++sp = slots[ip->a]; VM_NEXT(); }
+
+	// Arithmetic wraps around modulo 2^64 like the native code
+	VM_BINARY(add, a + b)
+	VM_BINARY(sub, a - b)
+	VM_BINARY(mul, a * b)
+	VM_DIVIDE(div)
+
+	VM_CASE(store) { slots[ip->a] = *sp--; VM_NEXT(); }
+
+	VM_CASE(jz)
+	{
+		if (*sp-- == 0) {
+			ip = code + ip->a;
+			VM_DISPATCH();
+		}
+
+		VM_NEXT();
+	}
+
+	VM_CASE(exit) { return { .value = *sp }; }
+
+#if !LGN_VM_THREADED
+		}
+	}
+#endif
+}
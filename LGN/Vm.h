@@ -0,0 +1,26 @@
+#pragma once
+#include "Bytecode.h"
+#include <cstdint>
+#include <vector>
+
+namespace lgn::vm
+{
+	struct Result {
+		// The full 64-bit exit value
+		uint64_t value = 0;
+		// The native code dies with SIGFPE where this is set
+		bool divided_by_zero = false;
+	};
+
+	// Runs bytecode programs. The slot and stack buffers are kept between
+	// runs, so running the same program repeatedly does not allocate.
+	class Machine
+	{
+	public:
+		Result run(const Program& program);
+
+	private:
+		std::vector<uint64_t> m_slots;
+		std::vector<uint64_t> m_stack;
+	};
+}
@@ -0,0 +1,141 @@
+#include "Watch.h"
+#include "Elf.h"
+#include "Error.h"
+#include "SourceFile.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <sys/inotify.h>
+#include <unistd.h>
+using namespace lgn;
+
+Watcher::Watcher(const Options& options, const std::vector<std::string>& inputs)
+	: m_options(options), m_compiler(options)
+{
+	for (const std::string& name : inputs) {
+		size_t slash = name.find_last_of('/');
+
+		m_inputs.push_back({
+			.name = name,
+			.directory = slash == std::string::npos ? "." : slash == 0 ? "/" : name.substr(0, slash),
+			.file_name = slash == std::string::npos ? name : name.substr(slash + 1),
+			.output = m_compiler.output_path(name),
+			.watch = -1,
+			.build = std::make_unique<Incremental>(options),
+		});
+	}
+}
+
+Watcher::~Watcher()
+{
+	if (m_fd >= 0)
+		close(m_fd);
+}
+
+int Watcher::run()
+{
+	m_fd = inotify_init1(IN_CLOEXEC);
+
+	if (m_fd < 0) {
+		std::cerr << "Unable to watch for changes: " << strerror(errno) << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// Inputs in the same directory share its watch
+	for (Input& input : m_inputs) {
+		input.watch = inotify_add_watch(m_fd, input.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+
+		if (input.watch < 0) {
+			std::cerr << "Unable to watch '" << input.directory << "': " << strerror(errno) << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (Input& input : m_inputs)
+		build(input);
+
+	alignas(inotify_event) char buffer[4096];
+	std::vector<char> changed(m_inputs.size());
+
+	while (true) {
+		ssize_t length = read(m_fd, buffer, sizeof(buffer));
+
+		if (length < 0 && errno == EINTR)
+			continue;
+
+		if (length <= 0)
+			break;
+
+		// A save often comes as several events, each input is built once
+		std::fill(changed.begin(), changed.end(), false);
+
+		for (ssize_t offset = 0; offset < length;) {
+			auto event = reinterpret_cast<const inotify_event*>(buffer + offset);
+			offset += sizeof(inotify_event) + event->len;
+
+			for (size_t i = 0; i < m_inputs.size(); i++) {
+				if (event->len != 0 && m_inputs[i].watch == event->wd && m_inputs[i].file_name == event->name)
+					changed[i] = true;
+			}
+		}
+
+		for (size_t i = 0; i < m_inputs.size(); i++) {
+			if (changed[i])
+				build(m_inputs[i]);
+		}
+	}
+
+	std::cerr << "Unable to read changes: " << strerror(errno) << std::endl;
+	return EXIT_FAILURE;
+}
+
+void Watcher::build(Input& input)
+{
+	auto start = std::chrono::steady_clock::now();
+	SourceFile source(input.name.c_str());
+
+	// Mid-save, the next event brings it back
+	if (!source.is_open()) {
+		report(input, "Unable to open '" + input.name + "'");
+		return;
+	}
+
+	try {
+		std::span<const uint8_t> code = input.build->build(source.view());
+
+		if (!elf::write_executable(input.output.c_str(), code)) {
+			report(input, "Unable to write '" + input.output + "'");
+			return;
+		}
+	} catch (const CompileError&) {
+		try {
+			m_compiler.compile(input.name, source.view());
+		} catch (const std::exception& error) {
+			report(input, error.what());
+		}
+
+		return;
+	} catch (const std::exception& error) {
+		// Whatever it was may have left the statements half updated, the
+		// next save starts over from scratch
+		input.build = std::make_unique<Incremental>(m_options);
+		report(input, error.what());
+		return;
+	}
+
+	if (m_options.verbose) {
+		auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+		std::ostringstream line;
+
+		line << "rebuilt " << input.build->rebuilt() << " of " << input.build->statement_count()
+			<< " statements in " << std::fixed << std::setprecision(1) << elapsed.count() << " ms";
+		report(input, line.str());
+	}
+}
+
+void Watcher::report(const Input& input, const std::string& line) const
+{
+	std::cerr << (m_options.batch ? input.name + ": " + line + "\n" : line + "\n");
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "Compiler.h"
+#include "Incremental.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lgn
+{
+	// Rebuilds the inputs every time one of them is written, until the
+	// process is interrupted. Each input keeps an Incremental, so an edit
+	// costs about as much as the statements it touched. When a build fails
+	// the input is compiled again from scratch, which reports the error
+	// exactly as a single compile would. Any other failure is reported too,
+	// a half-typed save never ends the process.
+	class Watcher
+	{
+	public:
+		Watcher(const Options& options, const std::vector<std::string>& inputs);
+
+		~Watcher();
+
+		// EXIT_FAILURE if the inputs cannot be watched, otherwise only
+		// returns if reading events fails
+		int run();
+
+	private:
+		struct Input {
+			std::string name;
+			// The directory is watched rather than the file, so editors
+			// that save by renaming a new file over it are seen too
+			std::string directory;
+			std::string file_name;
+			std::string output;
+			int watch = -1;
+			std::unique_ptr<Incremental> build;
+		};
+
+		const Options& m_options;
+		Compiler m_compiler;
+		std::vector<Input> m_inputs {};
+		int m_fd = -1;
+
+		void build(Input& input);
+		void report(const Input& input, const std::string& line) const;
+	};
+}
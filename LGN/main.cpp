@@ -1,42 +1,302 @@
-#include <fstream>
-#include "Lexer.h"
-#include "Parser.h"
-#include "Assembler.h"
+#include "Compiler.h"
+#include "Error.h"
+#include "Service.h"
+#include "ThreadPool.h"
+#include "Watch.h"
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <thread>
+#include <unistd.h>
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: lgn <input>" << std::endl;
+// What --run and --vm exit with when the program never ran, so a compile error is
+// not mistaken for a status the program chose. env and timeout use the
+// same for their own failures.
+static constexpr int not_run_status = 125;
+
+static lgn::service::Server* running_server = nullptr;
+
+static void stop_server(int)
+{
+    running_server->stop();
+}
+
+// Serves until SIGINT or SIGTERM
+static int serve(const std::string& socket_path, lgn::Cache* cache, size_t jobs)
+{
+    lgn::service::Server server(socket_path, cache, jobs ? jobs : std::max(1u, std::thread::hardware_concurrency()));
+
+    if (!server.listen()) {
+        std::cerr << "Unable to listen on '" << socket_path << "': " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    running_server = &server;
+
+    // No SA_RESTART, so the signal also interrupts accept()
+    struct sigaction action {};
+    action.sa_handler = stop_server;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    std::cerr << "lgn: serving on " << socket_path << std::endl;
+    server.run();
+
+    running_server = nullptr;
+    return EXIT_SUCCESS;
+}
+
+// Has the server compile the inputs and exits the way a local lgn would
+static int submit(const std::string& socket_path, const lgn::Options& options, bool use_cache,
+    const std::vector<std::string>& inputs)
+{
+    char directory[4096];
+
+    if (!getcwd(directory, sizeof(directory))) {
+        std::cerr << "Unable to get the working directory" << std::endl;
         return EXIT_FAILURE;
     }
 
-    std::string content;
-    {
-        std::stringstream content_stream;
-        std::fstream input(argv[1], std::ios::in);
+    lgn::service::Request request{
+        .directory = directory,
+        .opt_level = options.opt_level,
+        .verbose = options.verbose,
+        .use_nasm = options.use_nasm,
+        .pipeline = options.pipeline,
+        .use_cache = use_cache,
+        .batch = options.batch,
+        .inputs = {},
+    };
+
+    // "-" is standard input, sent as it is
+    for (const std::string& input : inputs) {
+        if (input == "-")
+            request.inputs.push_back({ .name = "-", .has_source = true, .source = std::string(std::istreambuf_iterator<char>(std::cin), {}) });
+        else
+            request.inputs.push_back({ .name = input });
+    }
+
+    std::vector<lgn::service::Result> results;
+
+    try {
+        results = lgn::service::submit(socket_path, request);
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+
+    for (const lgn::service::Result& result : results) {
+        std::cerr << result.diagnostics;
+
+        if (options.verbose && !result.output.empty())
+            std::cerr << "wrote " << result.output << "\n";
+
+        // A single input with an error in the program exits with success,
+        // as a local compile does
+        if (result.status == lgn::service::Status::failure
+            || (result.status == lgn::service::Status::compile_error && options.batch))
+            status = EXIT_FAILURE;
+    }
+
+    return status;
+}
+
+// Prints the time report and writes the trace, whichever were asked for
+static void write_profile(const lgn::Profiler* profiler, bool time_report, const char* trace_path)
+{
+    if (!profiler)
+        return;
+
+    if (time_report)
+        profiler->report(std::cerr);
+
+    if (trace_path && !profiler->write_trace(trace_path))
+        std::cerr << "Unable to write '" << trace_path << "'" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> inputs;
+    lgn::Options options;
+    size_t jobs = 0;
+    bool use_cache = true;
+    bool cache_stats = false;
+    bool time_report = false;
+    const char* trace_path = nullptr;
+    bool server = false;
+    bool client = false;
+    bool watch = false;
+    std::string socket_path = lgn::service::default_socket();
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--run") == 0) {
+            options.run = true;
+        } else if (strcmp(argv[i], "--vm") == 0) {
+            options.vm = true;
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            options.pipeline = true;
+        } else if (strcmp(argv[i], "--lex-threads") == 0 && i + 1 < argc) {
+            // 0 is every core
+            options.lex_threads = strtoul(argv[++i], nullptr, 10);
+
+            if (options.lex_threads == 0)
+                options.lex_threads = std::max(1u, std::thread::hardware_concurrency());
+        } else if (strcmp(argv[i], "--codegen-threads") == 0 && i + 1 < argc) {
+            options.codegen_threads = strtoul(argv[++i], nullptr, 10);
+
+            if (options.codegen_threads == 0)
+                options.codegen_threads = std::max(1u, std::thread::hardware_concurrency());
+        } else if (strcmp(argv[i], "--nasm") == 0) {
+            options.use_nasm = true;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            options.verbose = true;
+        } else if (strcmp(argv[i], "-O") == 0) {
+            options.opt_level = 1;
+        } else if (strncmp(argv[i], "-O", 2) == 0 && argv[i][2] >= '0' && argv[i][2] <= '9' && argv[i][3] == '\0') {
+            options.opt_level = argv[i][2] - '0';
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            use_cache = false;
+        } else if (strcmp(argv[i], "--cache-stats") == 0) {
+            cache_stats = true;
+        } else if (strcmp(argv[i], "--time-report") == 0) {
+            time_report = true;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0) {
+            server = true;
+        } else if (strcmp(argv[i], "--client") == 0) {
+            client = true;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watch = true;
+        } else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            jobs = strtoul(argv[++i], nullptr, 10);
+        } else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2] != '\0') {
+            jobs = strtoul(argv[i] + 2, nullptr, 10);
+        } else {
+            inputs.emplace_back(argv[i]);
+        }
+    }
+
+    // A cache that cannot be set up only costs the speedup
+    std::unique_ptr<lgn::Cache> cache;
+
+    if (use_cache || cache_stats) {
+        const char* limit = getenv("LGN_CACHE_SIZE");
+        cache = std::make_unique<lgn::Cache>(lgn::Cache::default_directory(),
+            limit ? strtoull(limit, nullptr, 10) << 20 : lgn::Cache::default_limit);
 
-        content_stream << input.rdbuf();
-        content = content_stream.str();
+        if (!cache->is_open())
+            cache.reset();
     }
 
-    lgn::Lexer lexer(std::move(content));
-    std::vector<Token> tokens = lexer.tokenize();
+    if (cache_stats) {
+        if (!cache) {
+            std::cerr << "No cache directory" << std::endl;
+            return EXIT_FAILURE;
+        }
 
-    lgn::Parser parser(std::move(tokens));
-    std::optional<lgn::node::Program> ast = parser.parse();
+        lgn::Cache::Stats stats = cache->stats();
+        uint64_t lookups = stats.hits + stats.misses;
 
-    if (!ast.has_value()) {
-        std::cerr << "No statements found" << std::endl;
+        std::cout << "cache directory: " << cache->directory() << "\n"
+            << "hits:            " << stats.hits << "\n"
+            << "misses:          " << stats.misses << "\n"
+            << "hit rate:        " << (lookups ? stats.hits * 100 / lookups : 0) << "%\n"
+            << "stores:          " << stats.stores << "\n"
+            << "evictions:       " << stats.evictions << "\n"
+            << "size:            " << (stats.bytes >> 10) << " KiB of " << (cache->limit() >> 10) << " KiB" << std::endl;
         return EXIT_SUCCESS;
     }
 
-    lgn::Assembler assembler(ast.value());
-    {
-        std::fstream output("out.asm", std::ios::out);
-        output << assembler.assemble();
+    if (server)
+        return serve(socket_path, cache.get(), jobs);
+
+    if (!use_cache)
+        cache.reset();
+
+    // --run and --vm hand the process exit code to the program, which only
+    // works for one, and the server would have to run it. --watch only
+    // builds executables, locally.
+    if (inputs.empty() || ((options.run || options.vm) && (inputs.size() > 1 || client))
+        || (watch && (options.run || options.vm || options.use_nasm || client))) {
+        std::cerr << "Usage: lgn [-O<level>] [-v] [--nasm | --run | --vm] [--pipeline | --lex-threads <n>] [--codegen-threads <n>] [--no-cache] [--time-report] [--trace <file>] <input>\n"
+            << "       lgn [-O<level>] [-v] [--nasm] [--pipeline | --lex-threads <n>] [--codegen-threads <n>] [--no-cache] [--time-report] [--trace <file>] [-j <threads>] <input>...\n"
+            << "       lgn --client [--socket <path>] [-O<level>] [-v] [--nasm] [--pipeline] [--no-cache] <input>...\n"
+            << "       lgn --serve [--socket <path>] [-j <threads>] [--no-cache]\n"
+            << "       lgn --watch [-O<level>] [-v] <input>...\n"
+            << "       lgn --cache-stats" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (client) {
+        options.batch = inputs.size() > 1 || jobs != 0;
+        return submit(socket_path, options, use_cache, inputs);
     }
 
-    system("nasm -felf64 out.asm -o out.o");
-    system("ld out.o -o out.exe");
+    if (watch) {
+        options.batch = inputs.size() > 1;
+
+        lgn::Watcher watcher(options, inputs);
+        return watcher.run();
+    }
+
+    std::unique_ptr<lgn::Profiler> profiler;
+
+    if (time_report || trace_path)
+        profiler = std::make_unique<lgn::Profiler>();
+
+    if (inputs.size() == 1 && jobs == 0) {
+        lgn::Compiler compiler(options, cache.get(), profiler.get());
+        bool runs_program = options.run || options.vm;
+        int status;
+
+        try {
+            status = compiler.compile(inputs[0]);
+        } catch (const lgn::CompileError& error) {
+            std::cerr << error.what() << std::endl;
+            status = runs_program ? not_run_status : EXIT_SUCCESS;
+        } catch (const std::exception& error) {
+            std::cerr << error.what() << std::endl;
+            status = runs_program ? not_run_status : EXIT_FAILURE;
+        }
+
+        write_profile(profiler.get(), time_report, trace_path);
+        return status;
+    }
+
+    // Batch mode: every input gets its own outputs, a failing input does not
+    // stop the others
+    options.batch = true;
+
+    if (jobs == 0)
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    lgn::ThreadPool pool(std::min(jobs, inputs.size()));
+    std::vector<std::unique_ptr<lgn::Compiler>> compilers(pool.thread_count());
+    std::vector<char> failed(inputs.size(), false);
+
+    for (auto& compiler : compilers)
+        compiler = std::make_unique<lgn::Compiler>(options, cache.get(), profiler.get());
+
+    pool.run(inputs.size(), [&](size_t index, size_t worker) {
+        try {
+            compilers[worker]->compile(inputs[index]);
+        } catch (const std::exception& error) {
+            std::cerr << inputs[index] + ": " + error.what() + "\n";
+            failed[index] = true;
+        }
+    });
+
+    write_profile(profiler.get(), time_report, trace_path);
+
+    for (char input_failed : failed) {
+        if (input_failed)
+            return EXIT_FAILURE;
+    }
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,165 @@
+#include "Generator.h"
+#include <vector>
+using namespace lgn;
+using namespace lgn::bench;
+
+namespace
+{
+	// splitmix64, fixed so the output does not depend on the standard library
+	class Random
+	{
+	public:
+		explicit Random(uint64_t seed) : m_state(seed) {}
+
+		uint64_t next()
+		{
+			uint64_t z = (m_state += 0x9E3779B97F4A7C15ull);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			return z ^ (z >> 31);
+		}
+
+		// Uniform enough in [0, bound) for bounds this small
+		inline uint64_t below(uint64_t bound) { return next() % bound; }
+
+		inline bool chance(uint64_t percent) { return below(100) < percent; }
+
+	private:
+		uint64_t m_state;
+	};
+
+	class Writer
+	{
+	public:
+		Writer(const GeneratorOptions& options) : m_options(options), m_random(options.seed) {}
+
+		std::string run()
+		{
+			m_text.reserve(m_options.statements * 48);
+
+			for (size_t i = 0; i < m_options.statements; i++) {
+				if (m_visible.size() < m_options.variables)
+					write_let(0);
+				else
+					write_if(0);
+			}
+
+			m_text += "exit(";
+			m_text += m_visible.empty() ? "0" : name(m_visible.back());
+			m_text += ");\n";
+
+			return std::move(m_text);
+		}
+
+	private:
+		const GeneratorOptions& m_options;
+		Random m_random;
+		std::string m_text {};
+
+		// Variables in scope, and the next free number for a name
+		std::vector<size_t> m_visible {};
+		size_t m_next_name = 0;
+
+		static std::string name(size_t number)
+		{
+			return "v" + std::to_string(number);
+		}
+
+		void indent(int depth)
+		{
+			m_text.append(depth * 4, ' ');
+		}
+
+		void write_let(int depth)
+		{
+			indent(depth);
+			m_text += "let ";
+			m_text += name(m_next_name);
+			m_text += " = ";
+			write_expr(m_options.expr_depth);
+			m_text += ";\n";
+
+			// Declared after its expression, which must not refer to it
+			m_visible.push_back(m_next_name++);
+		}
+
+		void write_if(int depth)
+		{
+			indent(depth);
+			m_text += "if (";
+			write_expr(m_options.expr_depth);
+			m_text += ") {\n";
+
+			size_t outer = m_visible.size();
+			uint64_t count = 1 + m_random.below(4);
+
+			for (uint64_t i = 0; i < count; i++) {
+				if (depth + 1 < m_options.if_depth && m_random.chance(30))
+					write_if(depth + 1);
+				else
+					write_let(depth + 1);
+			}
+
+			// Names are never reused, so the inner ones can simply go out of scope
+			m_visible.resize(outer);
+
+			indent(depth);
+			m_text += "}\n";
+		}
+
+		void write_expr(int depth)
+		{
+			if (depth <= 0 || m_random.chance(20)) {
+				write_leaf();
+				return;
+			}
+
+			bool paren = m_random.chance(25);
+
+			if (paren)
+				m_text += '(';
+
+			switch (m_random.below(4)) {
+			case 0:
+				write_expr(depth - 1);
+				m_text += " + ";
+				write_expr(depth - 1);
+				break;
+			case 1:
+				write_expr(depth - 1);
+				m_text += " - ";
+				write_expr(depth - 1);
+				break;
+			case 2:
+				write_expr(depth - 1);
+				m_text += " * ";
+				write_expr(depth - 1);
+				break;
+			default:
+				write_expr(depth - 1);
+				m_text += " / ";
+				m_text += std::to_string(1 + m_random.below(9));
+				break;
+			}
+
+			if (paren)
+				m_text += ')';
+		}
+
+		void write_leaf()
+		{
+			if (!m_visible.empty() && m_random.chance(60)) {
+				m_text += name(m_visible[m_random.below(m_visible.size())]);
+				return;
+			}
+
+			m_text += std::to_string(m_random.below(1000));
+		}
+	};
+}
+
+std::string bench::generate_program(const GeneratorOptions& options)
+{
+	Writer writer(options);
+	return writer.run();
+}
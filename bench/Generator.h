@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace lgn::bench
+{
+	struct GeneratorOptions {
+		uint64_t seed = 1;
+		// Top-level statements, each one a let or an if
+		size_t statements = 10'000;
+		// Levels of binary operators in an expression
+		int expr_depth = 4;
+		// How deep if scopes nest
+		int if_depth = 3;
+		// Top-level variables; once they are all declared only ifs follow
+		size_t variables = 256;
+	};
+
+	// Writes a valid LGN program for the options. The same options always
+	// give the same text, on any platform, so results stay comparable
+	// between commits. Divisions are by non-zero literals only and the
+	// program ends in an exit of the last variable, so it also runs.
+	std::string generate_program(const GeneratorOptions& options);
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdio>
+
+namespace lgn::bench
+{
+	// Quoted and escaped for the JSON results, names and labels are plain text
+	inline void print_json_string(const char* text)
+	{
+		putchar('"');
+
+		for (; *text; text++) {
+			if (*text == '"' || *text == '\\')
+				putchar('\\');
+
+			if (static_cast<unsigned char>(*text) >= 0x20)
+				putchar(*text);
+		}
+
+		putchar('"');
+	}
+}
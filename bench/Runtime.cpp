@@ -0,0 +1,406 @@
+// Runtime benchmark for the generated code. Compiles every kernel at each
+// optimization level, checks that all levels compute the same exit value
+// and times the code with a cycle counter. Speedup and code size tables
+// go to stderr, one JSON object per kernel and level goes to stdout.
+#include "Generator.h"
+#include "Json.h"
+#include "Compiler.h"
+#include "Jit.h"
+#include "Vm.h"
+#include "SourceFile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+#include <x86intrin.h>
+
+using namespace lgn;
+
+namespace
+{
+	// Core cycles in user mode from perf_event_open where the kernel
+	// allows it, the time stamp counter otherwise. The TSC ticks at a
+	// fixed reference rate, so frequency scaling shows up in its numbers.
+	class CycleCounter
+	{
+	public:
+		CycleCounter()
+		{
+			perf_event_attr attr {};
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.size = sizeof(attr);
+			attr.config = PERF_COUNT_HW_CPU_CYCLES;
+			attr.disabled = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+
+			m_fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+
+			if (m_fd >= 0) {
+				ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+				ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+
+		~CycleCounter()
+		{
+			if (m_fd >= 0)
+				close(m_fd);
+		}
+
+		inline const char* name() const { return m_fd >= 0 ? "cycles (perf_event_open)" : "reference cycles (rdtsc)"; }
+
+		inline uint64_t read() const
+		{
+			uint64_t value = 0;
+
+			if (m_fd >= 0 && ::read(m_fd, &value, sizeof(value)) == sizeof(value))
+				return value;
+
+			_mm_lfence();
+			value = __rdtsc();
+			_mm_lfence();
+
+			return value;
+		}
+
+	private:
+		int m_fd = -1;
+	};
+
+	struct Kernel {
+		std::string name;
+		std::string source;
+	};
+
+	struct Result {
+		uint64_t value = 0;
+		size_t code_bytes = 0;
+		double median = 0;
+		double best = 0;
+	};
+
+	// Cycles per call: calls are made in batches long enough to hide the
+	// cost of reading the counter, the median batch is reported
+	template <typename Fn>
+	Result measure(const Fn& function, const CycleCounter& counter, int samples)
+	{
+		Result result;
+		result.value = function();
+
+		size_t batch = 1;
+
+		for (;;) {
+			uint64_t start = counter.read();
+
+			for (size_t i = 0; i < batch; i++)
+				function();
+
+			if (counter.read() - start > 50'000 || batch >= (1 << 20))
+				break;
+
+			batch *= 2;
+		}
+
+		std::vector<double> per_call;
+		per_call.reserve(samples);
+
+		for (int sample = 0; sample < samples; sample++) {
+			uint64_t start = counter.read();
+
+			for (size_t i = 0; i < batch; i++)
+				function();
+
+			per_call.push_back(static_cast<double>(counter.read() - start) / batch);
+		}
+
+		std::sort(per_call.begin(), per_call.end());
+		result.median = per_call[per_call.size() / 2];
+		result.best = per_call.front();
+
+		return result;
+	}
+
+	bool read_file(const std::string& path, std::string& text)
+	{
+		SourceFile file(path.c_str());
+
+		if (!file.is_open())
+			return false;
+
+		text.assign(file.view());
+		return true;
+	}
+
+	void add_directory(const std::string& path, std::vector<Kernel>& kernels)
+	{
+		DIR* dir = opendir(path.c_str());
+
+		if (!dir)
+			return;
+
+		std::vector<std::string> names;
+
+		while (dirent* item = readdir(dir)) {
+			std::string_view name = item->d_name;
+
+			if (name.size() > 4 && name.ends_with(".lgn"))
+				names.emplace_back(name);
+		}
+
+		closedir(dir);
+		std::sort(names.begin(), names.end());
+
+		for (const std::string& name : names) {
+			Kernel kernel{ .name = name.substr(0, name.size() - 4), .source = {} };
+
+			if (read_file(path + "/" + name, kernel.source))
+				kernels.push_back(std::move(kernel));
+		}
+	}
+
+	void usage()
+	{
+		fprintf(stderr,
+			"Usage: lgn-runtime [options] [kernel.lgn | directory]...\n"
+			"  --levels <list>    optimization levels to compare, the first is the baseline (0,1,2)\n"
+			"  --samples <n>      timed batches per kernel and level, the median counts (201)\n"
+			"  --generated <n>    also time n programs from the benchmark generator\n"
+			"  --label <text>     tag stored with every result, e.g. a commit id\n"
+			"Without kernels the ones in bench/kernels are used.\n");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<int> levels = { 0, 1, 2 };
+	std::vector<Kernel> kernels;
+	std::vector<std::string> paths;
+	int samples = 201;
+	int generated = 0;
+	const char* label = "";
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if (arg[0] != '-') {
+			paths.emplace_back(arg);
+		} else if (!value) {
+			usage();
+			return EXIT_FAILURE;
+		} else if (strcmp(arg, "--levels") == 0) {
+			levels.clear();
+
+			for (const char* p = value; *p; p++) {
+				if (*p >= '0' && *p <= '9')
+					levels.push_back(*p - '0');
+			}
+
+			i++;
+		} else if (strcmp(arg, "--samples") == 0) {
+			samples = std::max(1, atoi(value));
+			i++;
+		} else if (strcmp(arg, "--generated") == 0) {
+			generated = std::max(0, atoi(value));
+			i++;
+		} else if (strcmp(arg, "--label") == 0) {
+			label = value;
+			i++;
+		} else {
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (paths.empty() && generated == 0)
+		paths.emplace_back("bench/kernels");
+
+	for (const std::string& path : paths) {
+		Kernel kernel;
+
+		if (path.ends_with(".lgn") && read_file(path, kernel.source)) {
+			size_t slash = path.find_last_of('/');
+			kernel.name = path.substr(slash == std::string::npos ? 0 : slash + 1, path.size() - 4 - (slash == std::string::npos ? 0 : slash + 1));
+			kernels.push_back(std::move(kernel));
+		} else {
+			add_directory(path, kernels);
+		}
+	}
+
+	for (int i = 0; i < generated; i++) {
+		bench::GeneratorOptions options;
+		options.seed = i + 1;
+		options.statements = 200;
+		options.variables = 64;
+
+		kernels.push_back({ .name = "generated" + std::to_string(i + 1), .source = bench::generate_program(options) });
+	}
+
+	if (kernels.empty() || levels.empty()) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	CycleCounter counter;
+	std::vector<std::vector<Result>> results(kernels.size());
+	std::vector<Result> vm_results(kernels.size());
+	bool mismatch = false;
+
+	for (size_t k = 0; k < kernels.size(); k++) {
+		for (int level : levels) {
+			Options options{ .opt_level = level, .run = true };
+			Compiler compiler(options);
+			std::span<const uint8_t> code;
+
+			try {
+				code = compiler.compile_code(kernels[k].source);
+			} catch (const std::exception& error) {
+				fprintf(stderr, "%s: %s\n", kernels[k].name.c_str(), error.what());
+				return EXIT_FAILURE;
+			}
+
+			jit::Function function(code);
+
+			if (!function.is_open()) {
+				fprintf(stderr, "Unable to map executable memory\n");
+				return EXIT_FAILURE;
+			}
+
+			Result result = measure(function, counter, samples);
+			result.code_bytes = code.size();
+			results[k].push_back(result);
+
+			if (result.value != results[k].front().value) {
+				fprintf(stderr, "%s: -O%d exits with %llu, -O%d with %llu\n", kernels[k].name.c_str(), level,
+					static_cast<unsigned long long>(result.value), levels.front(), static_cast<unsigned long long>(results[k].front().value));
+				mismatch = true;
+			}
+		}
+
+		// The bytecode VM runs the first level's program, it has to agree with the native code
+		Options options{ .opt_level = levels.front(), .vm = true };
+		Compiler compiler(options);
+		const vm::Program& program = compiler.compile_bytecode(kernels[k].source);
+		vm::Machine machine;
+
+		vm_results[k] = measure([&] { return machine.run(program).value; }, counter, samples);
+		vm_results[k].code_bytes = program.code.size() * sizeof(vm::Instr);
+
+		if (vm_results[k].value != results[k].front().value) {
+			fprintf(stderr, "%s: the VM exits with %llu, -O%d with %llu\n", kernels[k].name.c_str(),
+				static_cast<unsigned long long>(vm_results[k].value), levels.front(), static_cast<unsigned long long>(results[k].front().value));
+			mismatch = true;
+		}
+	}
+
+	fprintf(stderr, "counter: %s, median of %d batches\n\n", counter.name(), samples);
+
+	// Speedup over the first level
+	fprintf(stderr, "%-14s %5s", "kernel", "exit");
+
+	for (int level : levels)
+		fprintf(stderr, "  %9s-O%d", "cycles", level);
+
+	for (size_t l = 1; l < levels.size(); l++)
+		fprintf(stderr, "  %6s-O%d", "speedup", levels[l]);
+
+	fprintf(stderr, "  %12s  %8s\n", "cycles-vm", "vm-cost");
+
+	std::vector<double> log_speedup(levels.size(), 0.0);
+	std::vector<double> log_size(levels.size(), 0.0);
+	double log_vm_cost = 0.0;
+
+	for (size_t k = 0; k < kernels.size(); k++) {
+		fprintf(stderr, "%-14s %5llu", kernels[k].name.c_str(), static_cast<unsigned long long>(results[k].front().value & 0xFF));
+
+		for (const Result& result : results[k])
+			fprintf(stderr, "  %12.1f", result.median);
+
+		for (size_t l = 1; l < levels.size(); l++) {
+			double speedup = results[k][0].median / results[k][l].median;
+			log_speedup[l] += std::log(speedup);
+			fprintf(stderr, "  %8.2fx", speedup);
+		}
+
+		// How many times slower the VM is than the first level's native code
+		double vm_cost = vm_results[k].median / results[k][0].median;
+		log_vm_cost += std::log(vm_cost);
+		fprintf(stderr, "  %12.1f  %7.2fx\n", vm_results[k].median, vm_cost);
+	}
+
+	fprintf(stderr, "%-14s %5s", "geomean", "");
+
+	for (size_t l = 0; l < levels.size(); l++)
+		fprintf(stderr, "  %12s", "");
+
+	for (size_t l = 1; l < levels.size(); l++)
+		fprintf(stderr, "  %8.2fx", std::exp(log_speedup[l] / kernels.size()));
+
+	fprintf(stderr, "  %12s  %7.2fx", "", std::exp(log_vm_cost / kernels.size()));
+
+	// Code size relative to the first level
+	fprintf(stderr, "\n\n%-14s", "kernel");
+
+	for (int level : levels)
+		fprintf(stderr, "  %7s-O%d", "bytes", level);
+
+	for (size_t l = 1; l < levels.size(); l++)
+		fprintf(stderr, "  %7s-O%d", "size", levels[l]);
+
+	fputc('\n', stderr);
+
+	for (size_t k = 0; k < kernels.size(); k++) {
+		fprintf(stderr, "%-14s", kernels[k].name.c_str());
+
+		for (const Result& result : results[k])
+			fprintf(stderr, "  %10zu", result.code_bytes);
+
+		for (size_t l = 1; l < levels.size(); l++) {
+			double ratio = static_cast<double>(results[k][l].code_bytes) / results[k][0].code_bytes;
+			log_size[l] += std::log(ratio);
+			fprintf(stderr, "  %9.1f%%", ratio * 100);
+		}
+
+		fputc('\n', stderr);
+	}
+
+	fprintf(stderr, "%-14s", "geomean");
+
+	for (size_t l = 0; l < levels.size(); l++)
+		fprintf(stderr, "  %10s", "");
+
+	for (size_t l = 1; l < levels.size(); l++)
+		fprintf(stderr, "  %9.1f%%", std::exp(log_size[l] / kernels.size()) * 100);
+
+	fputc('\n', stderr);
+
+	for (size_t k = 0; k < kernels.size(); k++) {
+		for (size_t l = 0; l < levels.size(); l++) {
+			const Result& result = results[k][l];
+
+			printf("{\"label\":");
+			bench::print_json_string(label);
+			printf(",\"kernel\":");
+			bench::print_json_string(kernels[k].name.c_str());
+			printf(",\"opt_level\":%d,\"counter\":\"%s\",\"exit\":%llu,\"code_bytes\":%zu,"
+				"\"cycles_median\":%.1f,\"cycles_best\":%.1f,\"speedup\":%.4f}\n",
+				levels[l], counter.name(), static_cast<unsigned long long>(result.value & 0xFF),
+				result.code_bytes, result.median, result.best, results[k][0].median / result.median);
+		}
+	}
+
+	if (mismatch) {
+		fprintf(stderr, "\nexit values differ between optimization levels or the VM\n");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
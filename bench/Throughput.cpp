@@ -0,0 +1,445 @@
+// Compiler throughput benchmark. Generates programs of a few sizes, runs
+// every stage of the pipeline on them and reports the best time of each
+// stage over several iterations. The table goes to stderr, one JSON object
+// per program and stage goes to stdout for comparing runs across commits.
+// Heap allocations are counted too: the stages keep their tables from one
+// iteration to the next, so after the first one they should allocate
+// nothing per item. The lexer must not allocate at all then, the benchmark
+// fails if it does. Parallel lexing and code generation are measured at
+// 1, 2, 4... threads up to the core count, which gives their scaling
+// curves. The lexer also runs with each set of scan kernels the CPU
+// supports, whichever one LGN_SIMD or the CPU would pick.
+#include "Generator.h"
+#include "Json.h"
+#include "Lexer.h"
+#include "ParallelCodegen.h"
+#include "ParallelLexer.h"
+#include "Parser.h"
+#include "Optimizer.h"
+#include "FlatAst.h"
+#include "Resolver.h"
+#include "Scan.h"
+#include "Assembler.h"
+#include "Peephole.h"
+#include "Encoder.h"
+#include "OutputBuffer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace lgn;
+
+namespace
+{
+	std::atomic<uint64_t> allocation_count { 0 };
+}
+
+// Every operator new in the process goes through here
+void* operator new(size_t size)
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+
+	if (void* memory = malloc(size ? size : 1))
+		return memory;
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	free(memory);
+}
+
+namespace
+{
+	struct Stage {
+		std::string name;
+		// What the stage's throughput is counted in
+		const char* unit;
+		uint64_t items = 0;
+		uint64_t bytes = 0;
+		double best = 1e30;
+		// In the last iteration
+		uint64_t allocations = 0;
+	};
+
+	struct Preset {
+		const char* name;
+		bench::GeneratorOptions options;
+	};
+
+	class Clock
+	{
+	public:
+		Clock() : m_start(std::chrono::steady_clock::now()) {}
+
+		// Seconds since construction or the previous lap
+		double lap()
+		{
+			auto now = std::chrono::steady_clock::now();
+			double seconds = std::chrono::duration<double>(now - m_start).count();
+			m_start = now;
+			return seconds;
+		}
+
+	private:
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+	// Counts allocations the way Clock counts time
+	class AllocationCounter
+	{
+	public:
+		AllocationCounter() : m_start(allocation_count.load()) {}
+
+		uint64_t lap()
+		{
+			uint64_t now = allocation_count.load();
+			uint64_t count = now - m_start;
+			m_start = now;
+			return count;
+		}
+
+	private:
+		uint64_t m_start;
+	};
+
+	void record(Stage& stage, double seconds, uint64_t allocations, uint64_t items, uint64_t bytes)
+	{
+		stage.best = std::min(stage.best, seconds);
+		stage.allocations = allocations;
+		stage.items = items;
+		stage.bytes = bytes;
+	}
+
+	// Runs the pipeline over source iterations times, timing each stage
+	std::vector<Stage> measure(const std::string& source, int opt_level, int iterations)
+	{
+		std::vector<Stage> stages = {
+			{ .name = "lex", .unit = "tokens" },
+			{ .name = "parse", .unit = "tokens" },
+			{ .name = "optimize", .unit = "nodes" },
+			{ .name = "resolve", .unit = "nodes" },
+			{ .name = "codegen", .unit = "instructions" },
+			{ .name = "asm", .unit = "instructions" },
+		};
+
+		flat::Ast ast;
+		Interner interner;
+		std::vector<Token> tokens;
+		x86::Encoder encoder;
+
+		// The nasm text goes to memory so the disk does not show up in the numbers
+		int asm_fd = memfd_create("lgn-bench", 0);
+		OutputBuffer asm_out(asm_fd);
+
+		for (int i = 0; i < iterations; i++) {
+			ast.clear();
+			interner.clear();
+			encoder.reset();
+
+			tokens.clear();
+
+			Clock clock;
+			AllocationCounter allocations;
+			Lexer lexer(source, interner);
+			Token token;
+
+			while (lexer.next(token))
+				tokens.push_back(token);
+
+			record(stages[0], clock.lap(), allocations.lap(), tokens.size(), source.size());
+
+			TokenSpan span(tokens);
+			Parser parser(span, ast);
+			parser.parse();
+			record(stages[1], clock.lap(), allocations.lap(), tokens.size(), source.size());
+
+			// The resolver checks the names before the optimizer runs, both
+			// of its passes count as resolve
+			Resolver resolver(interner);
+			resolver.check(ast);
+			double check_time = clock.lap();
+			uint64_t check_allocations = allocations.lap();
+
+			Optimizer optimizer(ast, opt_level);
+			optimizer.optimize();
+			double optimize_time = clock.lap();
+			uint64_t optimize_allocations = allocations.lap();
+
+			resolver.resolve(ast);
+			double resolve_time = check_time + clock.lap();
+			uint64_t resolve_allocations = check_allocations + allocations.lap();
+
+			record(stages[2], optimize_time, optimize_allocations, opt_level >= 1 ? ast.size() : 0, 0);
+			record(stages[3], resolve_time, resolve_allocations, ast.size(), 0);
+
+			// Both backends see the same instruction stream, peephole included
+			auto generate = [&](x86::InstrSink& sink) {
+				Assembler assembler(ast);
+
+				if (opt_level >= 1) {
+					Peephole peephole(sink);
+					assembler.assemble(peephole);
+				} else {
+					assembler.assemble(sink);
+				}
+
+				return assembler.emitted();
+			};
+
+			clock.lap();
+			allocations.lap();
+			size_t instructions = generate(encoder);
+			record(stages[4], clock.lap(), allocations.lap(), instructions, encoder.bytes().size());
+
+			lseek(asm_fd, 0, SEEK_SET);
+			ftruncate(asm_fd, 0);
+			asm_out.reset(asm_fd);
+
+			clock.lap();
+			allocations.lap();
+			x86::AsmWriter writer(asm_out);
+			generate(writer);
+			asm_out.flush();
+			record(stages[5], clock.lap(), allocations.lap(), instructions, lseek(asm_fd, 0, SEEK_CUR));
+		}
+
+		asm_out.reset(-1);
+		close(asm_fd);
+
+		return stages;
+	}
+
+	// Lexes source with the scalar, SSE2 and AVX2 scan kernels, those the
+	// CPU has
+	std::vector<Stage> measure_kernels(const std::string& source, int iterations)
+	{
+		std::vector<Stage> stages;
+		Interner interner;
+		std::vector<Token> tokens;
+
+		for (const scan::Kernels* kernels : { &scan::scalar_kernels(), scan::sse2_kernels(), scan::avx2_kernels() }) {
+			if (!kernels)
+				continue;
+
+			stages.push_back({ .name = std::string("lex-") + kernels->name, .unit = "tokens" });
+
+			for (int i = 0; i < iterations; i++) {
+				interner.clear();
+				tokens.clear();
+
+				Clock clock;
+				AllocationCounter allocations;
+				Lexer lexer(source, interner, *kernels);
+				Token token;
+
+				while (lexer.next(token))
+					tokens.push_back(token);
+
+				record(stages.back(), clock.lap(), allocations.lap(), tokens.size(), source.size());
+			}
+		}
+
+		return stages;
+	}
+
+	// Lexes source and generates its code on pools of 1, 2, 4... threads
+	// up to the core count, merging the chunks and joining the ranges
+	// included
+	std::vector<Stage> measure_parallel(const std::string& source, int opt_level, int iterations)
+	{
+		std::vector<Stage> stages;
+		size_t cores = std::max(2u, std::thread::hardware_concurrency());
+
+		flat::Ast ast;
+		Interner interner;
+		Lexer lexer(source, interner);
+		Parser parser(lexer, ast);
+		parser.parse();
+
+		Resolver resolver(interner);
+		resolver.check(ast);
+
+		Optimizer optimizer(ast, opt_level);
+		optimizer.optimize();
+		resolver.resolve(ast);
+
+		std::vector<uint8_t> code;
+
+		for (size_t threads = 1; threads < cores * 2; threads *= 2) {
+			threads = std::min(threads, cores);
+
+			ThreadPool pool(threads);
+			Interner lex_interner;
+			stages.push_back({ .name = "lex-j" + std::to_string(threads), .unit = "tokens" });
+			stages.push_back({ .name = "codegen-j" + std::to_string(threads), .unit = "instructions" });
+
+			Stage& lex = stages[stages.size() - 2];
+			Stage& codegen = stages.back();
+
+			for (int i = 0; i < iterations; i++) {
+				lex_interner.clear();
+
+				Clock clock;
+				AllocationCounter allocations;
+				ParallelLexer parallel_lexer(source, lex_interner, pool);
+				parallel_lexer.tokenize();
+				record(lex, clock.lap(), allocations.lap(), parallel_lexer.count(), source.size());
+
+				ParallelCodegen parallel_codegen(ast, Assembler::Target::executable, opt_level >= 1, pool);
+				parallel_codegen.generate(code);
+				record(codegen, clock.lap(), allocations.lap(), parallel_codegen.emitted(), code.size());
+			}
+		}
+
+		return stages;
+	}
+
+	void usage()
+	{
+		fprintf(stderr,
+			"Usage: lgn-bench [options]\n"
+			"  --statements <n>   top-level statements, one program instead of the presets\n"
+			"  --depth <n>        levels of binary operators per expression (4)\n"
+			"  --nesting <n>      depth of nested if scopes (3)\n"
+			"  --vars <n>         top-level variables (256)\n"
+			"  --seed <n>         generator seed (1)\n"
+			"  --iterations <n>   runs per program, the best one counts (5)\n"
+			"  -O<level>          optimization level (0)\n"
+			"  --label <text>     tag stored with every result, e.g. a commit id\n"
+			"  --emit             print the generated program instead of measuring\n");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	bench::GeneratorOptions custom;
+	bool use_custom = false;
+	bool emit = false;
+	int iterations = 5;
+	int opt_level = 0;
+	const char* label = "";
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if (strcmp(arg, "--emit") == 0) {
+			emit = true;
+		} else if (strncmp(arg, "-O", 2) == 0 && arg[2] >= '0' && arg[2] <= '9' && arg[3] == '\0') {
+			opt_level = arg[2] - '0';
+		} else if (!value) {
+			usage();
+			return EXIT_FAILURE;
+		} else if (strcmp(arg, "--statements") == 0) {
+			custom.statements = strtoull(value, nullptr, 10);
+			use_custom = true;
+			i++;
+		} else if (strcmp(arg, "--depth") == 0) {
+			custom.expr_depth = atoi(value);
+			i++;
+		} else if (strcmp(arg, "--nesting") == 0) {
+			custom.if_depth = atoi(value);
+			i++;
+		} else if (strcmp(arg, "--vars") == 0) {
+			custom.variables = strtoull(value, nullptr, 10);
+			i++;
+		} else if (strcmp(arg, "--seed") == 0) {
+			custom.seed = strtoull(value, nullptr, 10);
+			i++;
+		} else if (strcmp(arg, "--iterations") == 0) {
+			iterations = std::max(1, atoi(value));
+			i++;
+		} else if (strcmp(arg, "--label") == 0) {
+			label = value;
+			i++;
+		} else {
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::vector<Preset> presets;
+
+	if (use_custom) {
+		presets.push_back({ .name = "custom", .options = custom });
+	} else {
+		// Sizes from a typical file to one that no longer fits in cache
+		for (auto [name, statements] : { std::pair("small", 500), std::pair("medium", 5'000), std::pair("large", 50'000) }) {
+			bench::GeneratorOptions options = custom;
+			options.statements = statements;
+			presets.push_back({ .name = name, .options = options });
+		}
+	}
+
+	if (emit) {
+		for (const Preset& preset : presets)
+			fputs(bench::generate_program(preset.options).c_str(), stdout);
+
+		return EXIT_SUCCESS;
+	}
+
+	fprintf(stderr, "%-8s %-11s %12s %14s %16s %10s %12s\n", "program", "stage", "ms", "items/s", "unit", "MB/s", "allocs/item");
+
+	// Lex stages that allocated after the first iteration
+	std::vector<std::string> allocating;
+
+	for (const Preset& preset : presets) {
+		std::string source = bench::generate_program(preset.options);
+
+		std::vector<Stage> stages = measure(source, opt_level, iterations);
+		std::vector<Stage> kernels = measure_kernels(source, iterations);
+		std::vector<Stage> parallel = measure_parallel(source, opt_level, iterations);
+		stages.insert(stages.end(), kernels.begin(), kernels.end());
+		stages.insert(stages.end(), parallel.begin(), parallel.end());
+
+		for (const Stage& stage : stages) {
+			// Nothing runs at -O0
+			if (stage.items == 0)
+				continue;
+
+			double per_second = stage.items / stage.best;
+			double mb_per_second = stage.bytes / stage.best / 1e6;
+
+			double allocations_per_item = static_cast<double>(stage.allocations) / stage.items;
+
+			if (stage.bytes > 0)
+				fprintf(stderr, "%-8s %-11s %12.3f %14.0f %16s %10.1f %12.4f\n", preset.name, stage.name.c_str(), stage.best * 1e3, per_second, stage.unit, mb_per_second, allocations_per_item);
+			else
+				fprintf(stderr, "%-8s %-11s %12.3f %14.0f %16s %10s %12.4f\n", preset.name, stage.name.c_str(), stage.best * 1e3, per_second, stage.unit, "-", allocations_per_item);
+
+			printf("{\"label\":");
+			bench::print_json_string(label);
+			printf(",\"program\":\"%s\",\"statements\":%zu,\"expr_depth\":%d,\"if_depth\":%d,\"variables\":%zu,\"seed\":%llu,"
+				"\"opt_level\":%d,\"source_bytes\":%zu,\"stage\":\"%s\",\"unit\":\"%s\",\"seconds\":%.9f,"
+				"\"items\":%llu,\"items_per_s\":%.0f,\"bytes\":%llu,\"bytes_per_s\":%.0f,\"allocations\":%llu}\n",
+				preset.name, preset.options.statements, preset.options.expr_depth, preset.options.if_depth, preset.options.variables,
+				static_cast<unsigned long long>(preset.options.seed), opt_level, source.size(), stage.name.c_str(), stage.unit, stage.best,
+				static_cast<unsigned long long>(stage.items), per_second, static_cast<unsigned long long>(stage.bytes), per_second == 0 ? 0.0 : stage.bytes / stage.best,
+				static_cast<unsigned long long>(stage.allocations));
+
+			// The first iteration fills the interner and the token vector
+			if (iterations > 1 && stage.name == "lex" && stage.allocations > 0)
+				allocating.push_back(std::string(preset.name) + ": " + std::to_string(stage.allocations) + " allocations");
+		}
+	}
+
+	for (const std::string& failure : allocating)
+		fprintf(stderr, "lex allocates after the first iteration, %s\n", failure.c_str());
+
+	return allocating.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,95 @@
+// Checks that a program is rejected the same way at every optimization
+// level. Names and literals are checked before the optimizer removes code,
+// so an undeclared or redeclared variable or a literal that does not fit
+// in 64 bits in a dead branch, after an exit or multiplied by zero is an
+// error at -O2 just as at -O0. Each case is
+// compiled at -O0, -O1 and -O2, once from scratch and once through an
+// Incremental build, and must fail with the expected message or compile
+// when none is expected. Truncated statements must be compile errors too,
+// never another exception. Exits with EXIT_FAILURE if any case does not.
+#include "Compiler.h"
+#include "Error.h"
+#include "Incremental.h"
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <string_view>
+
+using namespace lgn;
+
+namespace
+{
+	struct Case {
+		std::string_view source;
+		// Empty when the program compiles
+		std::string_view error;
+	};
+
+	constexpr Case cases[] = {
+		{ "if (0) { exit(y); } exit(1);", "Undeclared identifier 'y'" },
+		{ "let x = 1; if (0) { let x = 2; } exit(x);", "Identifier 'x' is already declared" },
+		{ "exit(0); exit(y);", "Undeclared identifier 'y'" },
+		{ "exit(y * 0);", "Undeclared identifier 'y'" },
+		{ "exit(0); let x = 1; let x = 2;", "Identifier 'x' is already declared" },
+		{ "if (1) { exit(2); } exit(y);", "Undeclared identifier 'y'" },
+		{ "{ exit(0); { exit(y); } }", "Undeclared identifier 'y'" },
+		{ "let x = 0; if (x) { exit(z); } exit(x);", "Undeclared identifier 'z'" },
+		{ "let x = 1 * y; exit(0);", "Undeclared identifier 'y'" },
+		{ "exit(0); let x = 1; exit(x);", "" },
+		{ "if (0) { let y = 1; exit(y); } let y = 2; exit(y);", "" },
+		{ "let x = 1; { let y = x; } let y = 3; exit(y * 0);", "" },
+		{ "if (0) { exit(99999999999999999999999); } exit(3);", "Integer literal '99999999999999999999999' does not fit in 64 bits" },
+		{ "exit(99999999999999999999999 * 0);", "Integer literal '99999999999999999999999' does not fit in 64 bits" },
+		{ "exit(0); let x = 18446744073709551616;", "Integer literal '18446744073709551616' does not fit in 64 bits" },
+		{ "exit(18446744073709551615);", "" },
+		{ "if", "Expected expression" },
+		{ "if (", "Expected expression" },
+		{ "let x = 1; if (x", "Expected ')'" },
+	};
+
+	// The message compile throws, empty when it succeeds
+	template <typename Fn>
+	std::string error_of(Fn compile)
+	{
+		try {
+			compile();
+		} catch (const CompileError& error) {
+			return error.what();
+		} catch (const std::exception& error) {
+			return std::string("not a compile error: ") + error.what();
+		}
+
+		return {};
+	}
+}
+
+int main()
+{
+	size_t failures = 0;
+
+	for (int level = 0; level <= 2; level++) {
+		Options options{ .opt_level = level };
+		Compiler compiler(options);
+
+		for (const Case& test : cases) {
+			Incremental incremental(options);
+
+			std::string full = error_of([&] { compiler.compile_code(test.source); });
+			std::string incremental_error = error_of([&] { incremental.build(test.source); });
+
+			for (const std::string* error : { &full, &incremental_error }) {
+				if (*error == test.error)
+					continue;
+
+				fprintf(stderr, "-O%d %s: %.*s\n    expected: %.*s\n    got: %s\n", level, error == &full ? "full" : "incremental",
+					static_cast<int>(test.source.size()), test.source.data(), static_cast<int>(test.error.size()), test.error.data(),
+					error->empty() ? "no error" : error->c_str());
+				failures++;
+			}
+		}
+	}
+
+	fprintf(stderr, "%zu cases at 3 levels, %zu failures\n", std::size(cases), failures);
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,144 @@
+// Checks that the compile server does not build up open descriptors.
+// A server runs in this process on a socket in a temporary directory
+// and gets requests that fail in different ways: a compile error during
+// --nasm code generation, a compile error in a native build, a missing
+// input and a good input, which fails too when nasm is not installed.
+// The server's descriptors are counted after a first round and again
+// after many more. Exits with EXIT_FAILURE if the count grew or a
+// request got the wrong status.
+#include "Service.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace lgn;
+
+namespace
+{
+	constexpr int rounds = 100;
+
+	size_t open_descriptors()
+	{
+		size_t count = 0;
+		DIR* dir = opendir("/proc/self/fd");
+
+		if (!dir)
+			return 0;
+
+		while (dirent* entry = readdir(dir)) {
+			if (entry->d_name[0] != '.')
+				count++;
+		}
+
+		closedir(dir);
+		return count;
+	}
+
+	// The server may still be closing a connection when a reply is in, so
+	// the count is taken once it stays the same for a while
+	size_t settled_descriptors()
+	{
+		size_t count = open_descriptors();
+
+		for (int i = 0; i < 100; i++) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			size_t next = open_descriptors();
+
+			if (next == count && i >= 5)
+				break;
+
+			count = next;
+		}
+
+		return count;
+	}
+
+	struct Check {
+		service::Request request;
+		service::Status expected;
+	};
+
+	service::Request request(const std::string& directory, const std::string& input, bool use_nasm)
+	{
+		return {
+			.directory = directory,
+			.use_nasm = use_nasm,
+			.use_cache = false,
+			.batch = true,
+			.inputs = { { .name = input } },
+		};
+	}
+}
+
+int main()
+{
+	char directory[] = "/tmp/lgn-server-test.XXXXXX";
+
+	if (!mkdtemp(directory)) {
+		perror("mkdtemp");
+		return EXIT_FAILURE;
+	}
+
+	std::string dir = directory;
+	std::ofstream(dir + "/literal.lgn") << "exit(99999999999999999999999);\n";
+	std::ofstream(dir + "/good.lgn") << "let x = 3; exit(x * 2);\n";
+
+	bool has_nasm = system("command -v nasm > /dev/null && command -v ld > /dev/null") == 0;
+	Check checks[] = {
+		{ request(dir, "literal.lgn", true), service::Status::compile_error },
+		{ request(dir, "literal.lgn", false), service::Status::compile_error },
+		{ request(dir, "missing.lgn", true), service::Status::failure },
+		{ request(dir, "good.lgn", true), has_nasm ? service::Status::ok : service::Status::failure },
+		{ request(dir, "good.lgn", false), service::Status::ok },
+	};
+
+	std::string socket_path = dir + "/lgn.sock";
+	service::Server server(socket_path, nullptr, 2);
+
+	if (!server.listen()) {
+		perror("listen");
+		return EXIT_FAILURE;
+	}
+
+	std::thread serving([&] { server.run(); });
+	size_t failures = 0;
+	size_t before = 0;
+
+	for (int round = 0; round <= rounds; round++) {
+		// The first round sets up whatever the workers keep
+		if (round == 1)
+			before = settled_descriptors();
+
+		for (const Check& check : checks) {
+			std::vector<service::Result> results = service::submit(socket_path, check.request);
+
+			if (results.size() != 1 || results[0].status != check.expected) {
+				if (failures++ < 10) {
+					fprintf(stderr, "%s%s: unexpected status %d\n", check.request.inputs[0].name.c_str(), check.request.use_nasm ? " --nasm" : "",
+						results.empty() ? -1 : static_cast<int>(results[0].status));
+				}
+			}
+		}
+	}
+
+	size_t after = settled_descriptors();
+
+	server.stop();
+	serving.join();
+
+	if (after > before) {
+		fprintf(stderr, "open descriptors went from %zu to %zu over %d rounds\n", before, after, rounds);
+		failures++;
+	}
+
+	system(("rm -rf '" + dir + "'").c_str());
+
+	fprintf(stderr, "%d rounds of %zu requests, %zu failures\n", rounds, std::size(checks), failures);
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}